@@ -1,23 +1,35 @@
 #ifndef DISTRCPP_DIST_H
 #define DISTRCPP_DIST_H
 
-Rcpp::NumericMatrix dist_mtom(const Rcpp::NumericVector& xlon,
-			      const Rcpp::NumericVector& xlat,
-			      const Rcpp::NumericVector& ylon,
-			      const Rcpp::NumericVector& ylat,
-			      std::string dist_function);
-
-Rcpp::NumericVector dist_df(const Rcpp::NumericVector& xlon,
-			    const Rcpp::NumericVector& xlat,
-			    const Rcpp::NumericVector& ylon,
-			    const Rcpp::NumericVector& ylat,
-			    std::string dist_function);
+SEXP dist_mtom(SEXP xlon,
+	       SEXP xlat,
+	       SEXP ylon,
+	       SEXP ylat,
+	       std::string dist_function,
+	       int block_size,
+	       int nthreads,
+	       std::string output);
+
+Rcpp::NumericVector dist_self(SEXP lon,
+			      SEXP lat,
+			      std::string dist_function,
+			      int block_size,
+			      int nthreads);
+
+SEXP dist_df(SEXP xlon,
+	     SEXP xlat,
+	     SEXP ylon,
+	     SEXP ylat,
+	     std::string dist_function,
+	     int nthreads,
+	     std::string output);
 
 Rcpp::NumericVector dist_1tom(const double& xlon,
 			      const double& xlat,
-			      const Rcpp::NumericVector& ylon,
-			      const Rcpp::NumericVector& ylat,
-			      std::string dist_function);
+			      SEXP ylon,
+			      SEXP ylat,
+			      std::string dist_function,
+			      int nthreads);
 
 double dist_1to1(const double& xlon,
 		 const double& xlat,
@@ -29,8 +41,8 @@ Rcpp::NumericVector inverse_dist_weight(const Rcpp::NumericVector& d,
 					double exp,
 					std::string transform);
 
-Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df,
-				      Rcpp::DataFrame y_df,
+Rcpp::DataFrame popdist_weighted_mean(SEXP x_df,
+				      SEXP y_df,
 				      std::string measure_col,
 				      std::string x_id = "id",
 				      std::string x_lon_col = "lon",
@@ -40,10 +52,14 @@ Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df,
 				      std::string pop_col = "pop",
 				      std::string dist_function = "Haversine",
 				      std::string dist_transform = "level",
-				      double decay = 2);
+				      double decay = 2,
+				      int nthreads = 0,
+				      double tolerance = 0,
+				      double max_dist = R_PosInf,
+				      int k_neighbors = 0);
 
-Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df,
-				   Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_weighted_mean(SEXP x_df,
+				   SEXP y_df,
 				   std::string measure_col,
 				   std::string x_id = "id",
 				   std::string x_lon_col = "lon",
@@ -52,10 +68,14 @@ Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df,
 				   std::string y_lat_col = "lat",
 				   std::string dist_function = "Haversine",
 				   std::string dist_transform = "level",
-				   double decay = 2);
+				   double decay = 2,
+				   int nthreads = 0,
+				   double tolerance = 0,
+				   double max_dist = R_PosInf,
+				   int k_neighbors = 0);
 
-Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
-			 Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_min(SEXP x_df,
+			 SEXP y_df,
 			 std::string x_id = "id",
 			 std::string y_id = "id",
 			 std::string x_lon_col = "lon",
@@ -64,8 +84,8 @@ Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
 			 std::string y_lat_col = "lat",
 			 std::string dist_function = "Haversine");
 
-Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df,
-			 Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_max(SEXP x_df,
+			 SEXP y_df,
 			 std::string x_id = "id",
 			 std::string y_id = "id",
 			 std::string x_lon_col = "lon",
@@ -74,8 +94,50 @@ Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df,
 			 std::string y_lat_col = "lat",
 			 std::string dist_function = "Haversine");
 
-Rcpp::DataFrame dist_sum_inv(Rcpp::DataFrame x_df,
-			     Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_knn(SEXP x_df,
+			 SEXP y_df,
+			 int k,
+			 std::string x_id = "id",
+			 std::string y_id = "id",
+			 std::string x_lon_col = "lon",
+			 std::string x_lat_col = "lat",
+			 std::string y_lon_col = "lon",
+			 std::string y_lat_col = "lat",
+			 std::string dist_function = "Haversine");
+
+Rcpp::DataFrame dist_within(SEXP x_df,
+			    SEXP y_df,
+			    double radius,
+			    std::string x_id = "id",
+			    std::string y_id = "id",
+			    std::string x_lon_col = "lon",
+			    std::string x_lat_col = "lat",
+			    std::string y_lon_col = "lon",
+			    std::string y_lat_col = "lat",
+			    std::string dist_function = "Haversine");
+
+Rcpp::List dist_mtom_sparse(SEXP xlon,
+			    SEXP xlat,
+			    SEXP ylon,
+			    SEXP ylat,
+			    double max_dist,
+			    std::string dist_function = "Haversine",
+			    int nthreads = 0);
+
+Rcpp::DataFrame dist_within_sum(SEXP x_df,
+				SEXP y_df,
+				Rcpp::NumericVector radius,
+				std::string measure_col = "",
+				std::string x_id = "id",
+				std::string x_lon_col = "lon",
+				std::string x_lat_col = "lat",
+				std::string y_lon_col = "lon",
+				std::string y_lat_col = "lat",
+				std::string dist_function = "Haversine",
+				int nthreads = 0);
+
+Rcpp::DataFrame dist_sum_inv(SEXP x_df,
+			     SEXP y_df,
 			     std::string x_id = "id",
 			     std::string y_id = "id",
 			     std::string x_lon_col = "lon",
@@ -85,7 +147,43 @@ Rcpp::DataFrame dist_sum_inv(Rcpp::DataFrame x_df,
 			     std::string dist_function = "Haversine",
 			     std::string dist_transform = "level",
 			     double decay = 2, 
-			     double scale_units = 1);
+			     double scale_units = 1,
+			     double tolerance = 0);
+
+SEXP prepare_points(SEXP x,
+		    SEXP lat = R_NilValue,
+		    std::string lon_col = "lon",
+		    std::string lat_col = "lat");
+
+SEXP geo_index_build(Rcpp::DataFrame y_df,
+		     std::string lon_col = "lon",
+		     std::string lat_col = "lat",
+		     bool projected = false);
+
+Rcpp::List geo_index_info(SEXP index);
+
+SEXP geo_index_save(SEXP index,
+		    std::string path,
+		    std::string id_col = "id");
+
+SEXP geo_index_load(std::string path,
+		    SEXP y_df = R_NilValue);
+
+SEXP dist_mtom_file(SEXP xlon,
+		    SEXP xlat,
+		    SEXP ylon,
+		    SEXP ylat,
+		    std::string path,
+		    std::string dist_function = "Haversine",
+		    int block_size = 0,
+		    int nthreads = 0,
+		    std::string output = "double");
+
+SEXP dist_mtom_read(std::string path,
+				   SEXP rows = R_NilValue,
+				   SEXP cols = R_NilValue);
+
+Rcpp::List dist_mtom_info(std::string path);
 
 #endif
 
@@ -0,0 +1,191 @@
+
+#ifndef DISTRCPP_GEOTREE_H
+#define DISTRCPP_GEOTREE_H
+#include <Rcpp.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+#include <points.h>
+
+// Spatial index over a set of ending points: a k-d tree on their 3D
+// positions. Points are split on the unit sphere (latitude taken as
+// given), so the antimeridian and the poles need no special care. Each
+// node keeps two bounding boxes of its points, one on the sphere of
+// radius a and one on the WGS84 ellipsoid (earth-centred coordinates),
+// in meters. The straight-line distance from a query to a box is a lower
+// bound on the Haversine distance (sphere) or the geodesic distance
+// (ellipsoid) to any point in the node. Exact distances are computed with
+// the batch kernels only for points in leaves the bounds cannot rule out.
+// A tree over projected coordinates (for the planar kinds) splits them in
+// the plane instead, and both boxes hold the plane box.
+
+// points per leaf
+#define GEO_LEAF 32
+
+// deepest level below the root that tree_search() has stack room for;
+// balanced trees stay far shallower, and loaded files are held to it
+#define GEO_MAX_DEPTH 126
+
+// Bounds are compared with a little slack so that rounding in them or in
+// the kernels never prunes a point brute force would pick. Near antipodal
+// points asin() is ill-conditioned, hence the relative term.
+#define GEO_REL_SLACK 1e-7
+#define GEO_ABS_SLACK 1e-3
+
+struct GeoNode {
+
+  // sphere box then ellipsoid box: min x, y, z, max x, y, z
+  double box[12];
+
+  // points [lo, hi) of the tree's point order; children, or -1 for a leaf
+  R_xlen_t lo, hi;
+  int left, right;
+
+};
+
+// Tree arrays are read through pointers, which point either into the
+// vectors here (built in this session) or into a mapped index file.
+struct GeoTree {
+
+  // ending points in tree order; perm[j] is the input index of point j
+  PointSet pts;
+  const R_xlen_t* perm;
+  const GeoNode* nodes;
+  R_xlen_t n_nodes;
+
+  // built over projected coordinates
+  bool planar;
+
+  std::vector<R_xlen_t> perm_store;
+  std::vector<GeoNode> node_store;
+
+  GeoTree() : perm(NULL), nodes(NULL), n_nodes(0), planar(false) {}
+
+private:
+
+  // pts is not copyable
+  GeoTree(const GeoTree&);
+  GeoTree& operator=(const GeoTree&);
+
+};
+
+// Index over the ending points of a data frame, behind an external
+// pointer of class "distRcpp_geo_index" whose protected slot holds the
+// data frame (if any). It keeps the id of each point as a string,
+// id_bytes[id_off[j], id_off[j + 1]), NA where id_na[j] is set, so that
+// an index loaded from a file needs no data frame to name its points.
+struct GeoIndex {
+
+  GeoTree tree;
+  const uint64_t* id_off;
+  const char* id_bytes;
+  const unsigned char* id_na;
+  double build_seconds;
+
+  std::vector<uint64_t> id_off_store;
+  std::vector<char> id_bytes_store;
+  std::vector<unsigned char> id_na_store;
+
+  // index file mapped into memory (or read into file_store where memory
+  // mapping is not available); NULL for an index built in this session
+  const void* map;
+  size_t map_bytes;
+  std::vector<double> file_store;
+
+  GeoIndex() : id_off(NULL), id_bytes(NULL), id_na(NULL),
+	       build_seconds(0), map(NULL), map_bytes(0) {}
+
+  ~GeoIndex();
+
+};
+
+// index behind an external pointer; NULL if x is not one
+const GeoIndex* as_geo_index(SEXP x);
+
+// ids of points rows of g (input order); negative rows give NA
+Rcpp::CharacterVector geo_index_ids(const GeoIndex& g,
+				    const std::vector<R_xlen_t>& rows);
+
+// fill p with the points of t in their input order
+void geo_tree_points(const GeoTree& t, PointSet& p);
+
+// whether queries with dist_kind kind can use a tree (one built planar
+// for the planar kinds)
+bool geo_tree_supports(int kind);
+
+// build t over the n points (degrees, or projected if planar); all must
+// be finite
+void geo_tree_build(GeoTree& t, const double* lon, const double* lat,
+		    R_xlen_t n, bool planar);
+
+// input index of the point of t nearest point i of x, with its distance
+// in *dist; ties go to the lowest index, as with which_min()
+R_xlen_t geo_tree_nearest(const GeoTree& t, int kind,
+			  const PointSet& x, R_xlen_t i, double* dist);
+
+// The k nearest points seen so far no farther than radius (inclusive), as
+// a max-heap on (distance, input index) so that ties go to the lowest
+// index; NaN distances are skipped
+struct GeoKnn {
+
+  size_t k;
+  double radius;
+  std::vector<std::pair<double, R_xlen_t> > heap;
+
+  GeoKnn() : k(0), radius(std::numeric_limits<double>::infinity()) {}
+
+  double worst() const {
+    return heap.size() < k ? radius : heap.front().first;
+  }
+
+  void add(double d, R_xlen_t j) {
+    std::pair<double, R_xlen_t> p(d, j);
+    if (!(d <= radius) || (heap.size() == k && !(p < heap.front())))
+      return;
+    if (heap.size() == k) {
+      std::pop_heap(heap.begin(), heap.end());
+      heap.pop_back();
+    }
+    heap.push_back(p);
+    std::push_heap(heap.begin(), heap.end());
+  }
+
+};
+
+// Points within radius (inclusive) as (input index, distance), in the
+// order they are found; NaN distances are skipped
+struct GeoWithin {
+
+  double radius;
+  std::vector<std::pair<R_xlen_t, double> > hits;
+
+  double worst() const { return radius; }
+
+  void add(double d, R_xlen_t j) {
+    if (d <= radius)
+      hits.push_back(std::make_pair(j, d));
+  }
+
+};
+
+// k nearest points of t to point i of x, added to knn
+void geo_tree_knn(const GeoTree& t, int kind, const PointSet& x,
+		  R_xlen_t i, GeoKnn& knn);
+
+// points of t within within.radius of point i of x, added to within
+void geo_tree_within(const GeoTree& t, int kind, const PointSet& x,
+		     R_xlen_t i, GeoWithin& within);
+
+// position of point i of x for geo_node_range() with dist_kind kind; q
+// holds 6 values
+void geo_tree_query(int kind, const PointSet& x, R_xlen_t i, double* q);
+
+// range [*lo, *hi] holding the dist_kind kind distances from the query at
+// q to every point in node
+void geo_node_range(const GeoNode& node, int kind, const double* q,
+		    double* lo, double* hi);
+
+#endif
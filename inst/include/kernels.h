@@ -0,0 +1,378 @@
+
+#ifndef DISTRCPP_KERNELS_H
+#define DISTRCPP_KERNELS_H
+#include <Rcpp.h>
+#include <algorithm>
+#include <cmath>
+#include <points.h>
+#include <shared.h>
+
+// Scalar distance kernels as types. Loops over pairs are templates on the
+// kernel, so each kernel gets its own copy of the loop with the per-pair
+// call inlined; the kernel is picked once per call with KERNEL_DISPATCH.
+// pair() takes degrees, prep() points i of x and j of y of prepared sets.
+
+// deg_to_rad(), inlined
+static inline double kernel_rad(double degree) {
+  return degree * M_PI / 180;
+}
+
+struct KernelHaversine {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    // return 0 if same point
+    if (xlon == ylon && xlat == ylat) return 0;
+
+    // convert degrees to radians
+    double xlonr = kernel_rad(xlon);
+    double xlatr = kernel_rad(xlat);
+    double ylonr = kernel_rad(ylon);
+    double ylatr = kernel_rad(ylat);
+
+    // compute parenthetical: sin(delta / 2)
+    double d1 = sin((ylatr - xlatr) / 2.);
+    double d2 = sin((ylonr - xlonr) / 2.);
+
+    return 2.0 * a * asin(sqrt(d1 * d1 + cos(xlatr) * cos(ylatr) * d2 * d2));
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    // return 0 if same point
+    if (x.lon[i] == y.lon[j] && x.lat[i] == y.lat[j]) return 0;
+
+    // sin(delta / 2) by the difference formula
+    double d1 = y.shlat[j] * x.chlat[i] - y.chlat[j] * x.shlat[i];
+    double d2 = y.shlon[j] * x.chlon[i] - y.chlon[j] * x.shlon[i];
+
+    // rounding can push antipodal points just past 1; NaN is kept
+    double h = d1 * d1 + x.clat[i] * y.clat[j] * d2 * d2;
+    if (h > 1) h = 1;
+
+    return 2.0 * a * asin(sqrt(h));
+
+  }
+
+};
+
+// the iteration dominates, so only the set up is inlined
+struct KernelVincenty {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    // return 0 if same point
+    if (xlon == ylon && xlat == ylat) return 0;
+
+    double U1 = atan((1. - f) * tan(kernel_rad(xlat)));
+    double U2 = atan((1. - f) * tan(kernel_rad(ylat)));
+
+    return vincenty_inverse(sin(U1), cos(U1), sin(U2), cos(U2),
+			    kernel_rad(ylon) - kernel_rad(xlon));
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    // return 0 if same point
+    if (x.lon[i] == y.lon[j] && x.lat[i] == y.lat[j]) return 0;
+
+    return vincenty_inverse(x.sU[i], x.cU[i], y.sU[j], y.cU[j],
+			    y.lonr[j] - x.lonr[i]);
+
+  }
+
+};
+
+// the solution (karney.cpp) works from degrees throughout
+struct KernelKarney {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    // return 0 if same point
+    if (xlon == ylon && xlat == ylat) return 0;
+
+    return karney_inverse(xlon, xlat, ylon, ylat);
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    return pair(x.lon[i], x.lat[i], y.lon[j], y.lat[j]);
+
+  }
+
+};
+
+// Andoyer-Lambert (first order in f) and Thomas (second order) distances
+// from the sines and cosines of the reduced latitudes and sin(dlon / 2).
+// Both correct the great circle distance sig between the reduced
+// latitudes, which is taken from its haversine term h as for Haversine.
+template <bool THOMAS>
+static inline double flattening_series(double sU1, double cU1,
+				       double sU2, double cU2, double sdl) {
+
+  // sin^2(dU / 2) without cancellation unless the points are near the
+  // opposite poles
+  double s = sU2 * cU1 - cU2 * sU1;
+  double c = cU1 * cU2 + sU1 * sU2;
+  double h = c >= 0 ? s * s / (2. * (1. + c)) : (1. - c) / 2.;
+  h += cU1 * cU2 * sdl * sdl;
+
+  // rounding can push antipodal points just past 1; NaN is kept
+  if (h > 1) h = 1;
+
+  double sig = 2. * asin(sqrt(h));
+  double ssig = 2. * sqrt(h * (1. - h));
+
+  // (sin U1 + sin U2)^2 / 2 cos^2(sig / 2), (sin U2 - sin U1)^2 / 2
+  // sin^2(sig / 2); both vanish where their denominators do
+  double p = sU1 + sU2, q = sU2 - sU1;
+  double X = h < 1 ? p * p / (2. * (1. - h)) : 0;
+  double Y = h > 0 ? q * q / (2. * h) : 0;
+
+  if (!THOMAS || !(ssig > 0))
+    return a * (sig - f / 4. * ((sig - ssig) * X + (sig + ssig) * Y));
+
+  double T = sig / ssig;
+  double D = 4. * T * T;
+  double E = 2. * (1. - 2. * h);
+  double A = D * E;
+  double C = T - (A - E) / 2.;
+  double U = X + Y, V = X - Y;
+
+  double d1 = f / 4. * (T * U - V);
+  double d2 = f * f / 64. *
+    (U * (A + C * U) - V * (2. * D + E * V) + D * U * V);
+
+  return a * ssig * (T - d1 + d2);
+
+}
+
+// sine and cosine of reduced latitude, inlined
+static inline void kernel_reduced(double lat, double* sU, double* cU) {
+  double ts = (1. - f) * sin(kernel_rad(lat));
+  double c = cos(kernel_rad(lat));
+  double r = sqrt(ts * ts + c * c);
+  *sU = ts / r;
+  *cU = c / r;
+}
+
+template <bool THOMAS>
+struct KernelFlattening {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    // return 0 if same point
+    if (xlon == ylon && xlat == ylat) return 0;
+
+    double sU1, cU1, sU2, cU2;
+    kernel_reduced(xlat, &sU1, &cU1);
+    kernel_reduced(ylat, &sU2, &cU2);
+
+    return flattening_series<THOMAS>(sU1, cU1, sU2, cU2,
+				     sin((kernel_rad(ylon) -
+					  kernel_rad(xlon)) / 2.));
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    // return 0 if same point
+    if (x.lon[i] == y.lon[j] && x.lat[i] == y.lat[j]) return 0;
+
+    // sin(dlon / 2) by the difference formula
+    double sdl = y.shlon[j] * x.chlon[i] - y.chlon[j] * x.shlon[i];
+
+    return flattening_series<THOMAS>(x.sU[i], x.cU[i], y.sU[j], y.cU[j],
+				     sdl);
+
+  }
+
+};
+
+typedef KernelFlattening<false> KernelAndoyer;
+typedef KernelFlattening<true> KernelThomas;
+
+// Straight-line and city-block distances between projected coordinates,
+// in their units. Plain arithmetic rather than hypot(), as the batch
+// kernels have it.
+template <bool MANHATTAN>
+struct KernelPlanar {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    double dx = ylon - xlon;
+    double dy = ylat - xlat;
+
+    if (MANHATTAN)
+      return std::fabs(dx) + std::fabs(dy);
+
+    return sqrt(dx * dx + dy * dy);
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    return pair(x.lon[i], x.lat[i], y.lon[j], y.lat[j]);
+
+  }
+
+};
+
+typedef KernelPlanar<false> KernelEuclidean;
+typedef KernelPlanar<true> KernelManhattan;
+
+// Equirectangular distance for latitude and longitude differences u and v
+// (radians) about a mean latitude with cosine c. It is never shorter than
+// the great circle distance, and for spans up to FAST_MAX_SPAN exceeds it
+// by at most 1.001 times a v^2 (3 |u| + c (1 - c^2) |v|) / 24. NaN where
+// that bound (with a margin) tops FAST_MAX_ERROR, or the span is wider,
+// for the caller to use Haversine instead.
+static inline double fast_equirect(double u, double v, double c) {
+
+  double au = std::fabs(u), av = std::fabs(v);
+  double excess = 1.01 * a / 24. * v * v * (3. * au + c * (1. - c * c) * av);
+
+  if (!(au <= FAST_MAX_SPAN && av <= FAST_MAX_SPAN &&
+	excess <= FAST_MAX_ERROR))
+    return NAN;
+
+  return a * sqrt(u * u + c * c * v * v);
+
+}
+
+// Equirectangular distance where it is within FAST_MAX_ERROR of the
+// Haversine distance, Haversine elsewhere. Longitudes are not wrapped, so
+// pairs across the antimeridian take Haversine.
+struct KernelFast {
+
+  static inline double pair(double xlon, double xlat,
+			    double ylon, double ylat) {
+
+    // return 0 if same point
+    if (xlon == ylon && xlat == ylat) return 0;
+
+    double xlatr = kernel_rad(xlat);
+    double ylatr = kernel_rad(ylat);
+    double dlon = kernel_rad(ylon) - kernel_rad(xlon);
+    double d = fast_equirect(ylatr - xlatr, dlon, cos((xlatr + ylatr) / 2.));
+
+    return std::isnan(d) ? KernelHaversine::pair(xlon, xlat, ylon, ylat) : d;
+
+  }
+
+  static inline double prep(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, R_xlen_t j) {
+
+    // return 0 if same point
+    if (x.lon[i] == y.lon[j] && x.lat[i] == y.lat[j]) return 0;
+
+    // cosine of the mean latitude from the half angles
+    double c = x.chlat[i] * y.chlat[j] - x.shlat[i] * y.shlat[j];
+
+    double d = fast_equirect(y.latr[j] - x.latr[i], y.lonr[j] - x.lonr[i],
+			     c);
+
+    return std::isnan(d) ? KernelHaversine::prep(x, i, y, j) : d;
+
+  }
+
+};
+
+// run stmt with K naming the kernel type for dist_kind kind
+#define KERNEL_DISPATCH(kind, K, stmt)				\
+  switch (kind) {						\
+  case DIST_VINCENTY: { typedef KernelVincenty K; stmt; } break;	\
+  case DIST_KARNEY: { typedef KernelKarney K; stmt; } break;	\
+  case DIST_ANDOYER: { typedef KernelAndoyer K; stmt; } break;	\
+  case DIST_THOMAS: { typedef KernelThomas K; stmt; } break;	\
+  case DIST_EUCLIDEAN: { typedef KernelEuclidean K; stmt; } break; \
+  case DIST_MANHATTAN: { typedef KernelManhattan K; stmt; } break; \
+  case DIST_FAST: { typedef KernelFast K; stmt; } break;		\
+  default: { typedef KernelHaversine K; stmt; } break;		\
+  }
+
+// one starting point (degrees) to n ending points
+template <class K>
+void kernel_1tom(double xlon, double xlat,
+		 const double* ylon, const double* ylat,
+		 R_xlen_t n, double* out) {
+  for (R_xlen_t j = 0; j < n; j++)
+    out[j] = K::pair(xlon, xlat, ylon[j], ylat[j]);
+}
+
+// n corresponding pairs (degrees)
+template <class K>
+void kernel_pairs(const double* xlon, const double* xlat,
+		  const double* ylon, const double* ylat,
+		  R_xlen_t n, double* out) {
+  for (R_xlen_t j = 0; j < n; j++)
+    out[j] = K::pair(xlon[j], xlat[j], ylon[j], ylat[j]);
+}
+
+// point i of x to points [lo, hi) of y; out holds hi - lo values
+template <class K>
+void kernel_prep_1tom(const PointSet& x, R_xlen_t i,
+		      const PointSet& y, R_xlen_t lo, R_xlen_t hi,
+		      double* out) {
+  for (R_xlen_t j = lo; j < hi; j++)
+    out[j - lo] = K::prep(x, i, y, j);
+}
+
+// corresponding points [lo, hi) of x and y
+template <class K>
+void kernel_prep_pairs(const PointSet& x, const PointSet& y,
+		       R_xlen_t lo, R_xlen_t hi, double* out) {
+  for (R_xlen_t j = lo; j < hi; j++)
+    out[j - lo] = K::prep(x, j, y, j);
+}
+
+// Inverse distance weight 1 / t(d)^decay, t the identity ("level") or
+// log. The transform and the common decays 1 and 2 are template arguments,
+// so the per-pair weight is a multiply and divide rather than a string
+// comparison and pow(); other decays use pow() with the stored value.
+template <bool LOG, int DECAY>
+struct InvWeight {
+
+  double decay;
+
+  inline double operator()(double d) const {
+    double t = LOG ? log(d) : d;
+    if (DECAY == 1) return 1 / t;
+    if (DECAY == 2) return 1 / (t * t);
+    return 1 / pow(t, decay);
+  }
+
+};
+
+// run stmt with W naming the weight type for transform and decay, and w
+// an instance of it
+#define WEIGHT_DISPATCH(log_transform, decay, W, w, stmt)		\
+  if (log_transform) {							\
+    WEIGHT_DISPATCH_DECAY(true, decay, W, w, stmt)			\
+  } else {								\
+    WEIGHT_DISPATCH_DECAY(false, decay, W, w, stmt)			\
+  }
+
+#define WEIGHT_DISPATCH_DECAY(LOG, decay, W, w, stmt)			\
+  if (decay == 1) {							\
+    typedef InvWeight<LOG, 1> W; W w = { decay }; stmt;			\
+  } else if (decay == 2) {						\
+    typedef InvWeight<LOG, 2> W; W w = { decay }; stmt;			\
+  } else {								\
+    typedef InvWeight<LOG, 0> W; W w = { decay }; stmt;			\
+  }
+
+#endif
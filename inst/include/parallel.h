@@ -0,0 +1,84 @@
+
+#ifndef DISTRCPP_PARALLEL_H
+#define DISTRCPP_PARALLEL_H
+#include <Rcpp.h>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// number of coordinate pairs per chunk for pairwise loops
+#define PAIR_GRAIN 4096
+
+// number of chunks per thread run between interrupt checks
+#define CHUNKS_PER_WAVE 4
+
+int resolve_threads(int nthreads);
+
+// number of rows of k pairs each to hand out per chunk
+inline R_xlen_t row_grain(R_xlen_t k) {
+  return std::max((R_xlen_t)1, PAIR_GRAIN / std::max((R_xlen_t)1, k));
+}
+
+// index of the calling thread within the current team
+inline int thread_id() {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+// Run body(lo, hi) over [0, n) in chunks of `grain` spread across
+// `nthreads` OpenMP threads. The body must only read plain C++ data and
+// write into raw buffers: it runs off the main thread and must not touch
+// the R API. Work is issued in waves so that the main thread can check
+// for a user interrupt between them. The first std::exception thrown by a
+// worker is rethrown on the main thread once its wave is done.
+template <class Body>
+void parallel_for(R_xlen_t n, R_xlen_t grain, int nthreads, const Body& body) {
+
+  if (n <= 0) return;
+  if (grain < 1) grain = 1;
+
+  R_xlen_t nchunks = (n + grain - 1) / grain;
+  R_xlen_t wave = (R_xlen_t)nthreads * CHUNKS_PER_WAVE;
+  bool failed = false;
+  std::string msg;
+
+  for (R_xlen_t w = 0; w < nchunks; w += wave) {
+
+    // check for interrupt
+    Rcpp::checkUserInterrupt();
+
+    R_xlen_t wend = std::min(w + wave, nchunks);
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(nthreads) schedule(dynamic)
+#endif
+    for (R_xlen_t c = w; c < wend; c++) {
+
+      try {
+	body(c * grain, std::min((c + 1) * grain, n));
+      } catch (std::exception& e) {
+#ifdef _OPENMP
+#pragma omp critical(distrcpp_error)
+#endif
+	{
+	  if (!failed) {
+	    failed = true;
+	    msg = e.what();
+	  }
+	}
+      }
+    }
+
+    if (failed)
+      throw Rcpp::exception(msg.c_str(), false);
+
+  }
+}
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef DISTRCPP_POINTS_H
+#define DISTRCPP_POINTS_H
+#include <Rcpp.h>
+#include <string>
+#include <vector>
+
+// Prepared coordinate set, stored as a structure of arrays. Everything a
+// distance kernel needs from one end of a pair is computed once per point
+// here rather than once per pair:
+//   lon, lat      degrees, as given
+//   lonr, latr    radians
+//   clat          cos(lat)
+//   shlat, chlat  sin / cos of lat / 2
+//   shlon, chlon  sin / cos of lon / 2
+//   sU, cU        sin / cos of reduced latitude, tan(U) = (1 - f) tan(lat)
+// The half angles give Haversine's sin(delta / 2) terms by the difference
+// formula, so a prepared Haversine pair needs only sqrt and asin.
+struct PointSet {
+
+  R_xlen_t n;
+  const double* lon;
+  const double* lat;
+  const double* lonr;
+  const double* latr;
+  const double* clat;
+  const double* shlat;
+  const double* chlat;
+  const double* shlon;
+  const double* chlon;
+  const double* sU;
+  const double* cU;
+
+  std::vector<double> store;
+
+  PointSet() : n(0) {}
+
+private:
+
+  // columns point into store
+  PointSet(const PointSet&);
+  PointSet& operator=(const PointSet&);
+
+};
+
+// number of double columns held per point
+#define POINT_COLUMNS 11
+
+// point the columns of p at block, which holds POINT_COLUMNS columns of
+// n values each, in the order above; p.store is left as it is
+void point_columns(PointSet& p, const double* block, R_xlen_t n);
+
+// fill p from n points in degrees
+void prepare_into(PointSet& p, const double* lon, const double* lat,
+		  R_xlen_t n);
+
+// prepared set behind an external pointer; NULL if x is not one
+const PointSet* as_points(SEXP x);
+
+// coordinates for lon / lat vectors: the prepared set if lon is one,
+// otherwise tmp filled from the vectors
+const PointSet& points_of(SEXP lon, SEXP lat, PointSet& tmp);
+
+// coordinates for a data frame, or a prepared set or geo index built
+// from one
+const PointSet& frame_points(SEXP x_df, std::string lon_col,
+			     std::string lat_col, PointSet& tmp);
+
+// data frame behind x_df: x_df itself or the one a prepared set or
+// index was built from
+Rcpp::DataFrame frame_of(SEXP x_df);
+
+#endif
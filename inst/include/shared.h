@@ -6,6 +6,18 @@
 #define f 1 / 298.257223563
 #define b (1. - f) * a
 
+// cache budget (bytes) used to size tiles of many-to-many output
+#define TILE_CACHE_BYTES 262144
+
+// ending points per block of distances streamed through fused reductions
+#define FUSE_BLOCK 256
+
+// largest error (meters) of the "Fast" equirectangular distance, and the
+// latitude / longitude span (radians) past which it is not tried; pairs
+// that could exceed either get the Haversine distance instead
+#define FAST_MAX_ERROR 0.5
+#define FAST_MAX_SPAN 0.1
+
 double deg_to_rad(const double& degree);
 
 double dist_haversine(const double& xlon,
@@ -18,16 +30,58 @@ double dist_vincenty(const double& xlon,
 		     const double& ylon,
 		     const double& ylat);
 
+double dist_karney(const double& xlon,
+		   const double& xlat,
+		   const double& ylon,
+		   const double& ylat);
+
+double vincenty_inverse(double sinU1,
+			double cosU1,
+			double sinU2,
+			double cosU2,
+			double L);
+
+double karney_inverse(double xlon, double xlat, double ylon, double ylat);
+
 Rcpp::NumericVector inverse_value(const Rcpp::NumericVector& d,
 				  double exp,
 				  std::string transform);
 
-typedef double (*funcPtr)(const double& xlon,
-			  const double& xlat,
-			  const double& ylon,
-			  const double& ylat);
+// distance functions, resolved once per call from their names
+enum dist_kind { DIST_HAVERSINE, DIST_VINCENTY, DIST_KARNEY, DIST_ANDOYER,
+		 DIST_THOMAS, DIST_EUCLIDEAN, DIST_MANHATTAN, DIST_FAST };
+
+// distance function for name; stops with an error if there is none
+int dist_kind_of(const std::string& dist_function);
+
+// whether dist_kind kind measures geodesics on the ellipsoid rather than
+// great circles on the sphere of radius a
+bool dist_on_ellipsoid(int kind);
+
+// whether dist_kind kind takes projected coordinates (x for longitude, y
+// for latitude) and measures in their units
+bool dist_is_planar(int kind);
+
+int tile_size(int block_size);
+
+// Value types of distances returned to R: doubles, or 4-byte values held
+// in an integer vector marked with a dist_output attribute (the bits of a
+// single precision float, or distances rounded to whole meters or
+// decimeters; NA where not finite)
+enum out_kind { OUT_DOUBLE, OUT_FLOAT, OUT_METERS, OUT_DECIMETERS };
+
+// output type for name; stops with an error if there is none
+int out_kind_of(const std::string& output);
+
+// name of output type
+const char* out_kind_name(int output);
+
+// vector of len values of output type, with its buffer in *data
+Rcpp::RObject alloc_dist(int output, R_xlen_t len, void** data);
 
-Rcpp::XPtr<funcPtr> choose_func(std::string funcnamestr);
+// store the len distances at d as output type from element at of data
+void store_dist(int output, const double* d, R_xlen_t len, void* data,
+		R_xlen_t at);
 
 #endif
 
@@ -0,0 +1,140 @@
+
+#ifndef DISTRCPP_SIMD_H
+#define DISTRCPP_SIMD_H
+#include <Rcpp.h>
+#include <points.h>
+
+// Batch Haversine kernels. The instruction set is chosen once when the
+// package is loaded (see simd_level()). Results differ from the scalar
+// dist_haversine() by at most HAVERSINE_SIMD_MAX_ERROR meters for
+// distances up to HAVERSINE_SIMD_MAX_SPAN meters. Closer to antipodal the
+// formula itself is ill-conditioned (asin near 1) and a last-bit change in
+// the haversine term moves the distance by up to
+// HAVERSINE_SIMD_MAX_REL_ERROR of its value (~0.2 m), for either kernel.
+#define HAVERSINE_SIMD_MAX_ERROR 1e-7
+#define HAVERSINE_SIMD_MAX_SPAN 1.9e7
+#define HAVERSINE_SIMD_MAX_REL_ERROR 1e-8
+
+// Batch Vincenty kernels iterate several pairs at once, one per lane,
+// refilling lanes as pairs converge. Pairs whose stopping iteration could
+// differ from dist_vincenty()'s are passed to it, so results agree to
+// within VINCENTY_SIMD_MAX_ERROR meters (about 1e-8 m in practice).
+#define VINCENTY_SIMD_MAX_ERROR 1e-6
+
+// Batch Andoyer-Lambert and Thomas kernels differ from the scalar ones
+// only by the rounding of the vector sin and asin, as for Haversine
+
+// Batch Manhattan kernels give the same results as the scalar ones, and
+// batch Euclidean kernels differ only where the compiler fuses the sum of
+// squares (a last-bit change)
+
+// Batch distances for dist_kind kind (see shared.h). Each kind is
+// dispatched to the widest vector kernel available, falling back to the
+// scalar loops in kernels.h.
+
+// one starting point (degrees) to n ending points
+void batch_1tom(int kind,
+		double xlon,
+		double xlat,
+		const double* ylon,
+		const double* ylat,
+		R_xlen_t n,
+		double* out);
+
+// n corresponding pairs of starting and ending points (degrees)
+void batch_pairs(int kind,
+		 const double* xlon,
+		 const double* xlat,
+		 const double* ylon,
+		 const double* ylat,
+		 R_xlen_t n,
+		 double* out);
+
+// as above for prepared point sets: point i of x to points [lo, hi) of y,
+// or corresponding points [lo, hi) of x and y; out holds hi - lo values
+void batch_prep_1tom(int kind,
+		     const PointSet& x,
+		     R_xlen_t i,
+		     const PointSet& y,
+		     R_xlen_t lo,
+		     R_xlen_t hi,
+		     double* out);
+
+void batch_prep_pairs(int kind,
+		      const PointSet& x,
+		      const PointSet& y,
+		      R_xlen_t lo,
+		      R_xlen_t hi,
+		      double* out);
+
+std::string simd_level();
+
+// per instruction set entry points (x86-64 only)
+#define SIMD_DECLARE(ISA)						\
+  void haversine_1tom_##ISA(double xlon, double xlat,			\
+			    const double* ylon, const double* ylat,	\
+			    R_xlen_t n, double* out);			\
+  void haversine_pairs_##ISA(const double* xlon, const double* xlat,	\
+			     const double* ylon, const double* ylat,	\
+			     R_xlen_t n, double* out);			\
+  void vincenty_1tom_##ISA(double xlon, double xlat,			\
+			   const double* ylon, const double* ylat,	\
+			   R_xlen_t n, double* out);			\
+  void vincenty_pairs_##ISA(const double* xlon, const double* xlat,	\
+			    const double* ylon, const double* ylat,	\
+			    R_xlen_t n, double* out);			\
+  void haversine_prep_1tom_##ISA(const PointSet& x, R_xlen_t i,	\
+				 const PointSet& y, R_xlen_t lo,	\
+				 R_xlen_t hi, double* out);		\
+  void haversine_prep_pairs_##ISA(const PointSet& x, const PointSet& y, \
+				  R_xlen_t lo, R_xlen_t hi, double* out); \
+  void vincenty_prep_1tom_##ISA(const PointSet& x, R_xlen_t i,	\
+				const PointSet& y, R_xlen_t lo,		\
+				R_xlen_t hi, double* out);		\
+  void vincenty_prep_pairs_##ISA(const PointSet& x, const PointSet& y,	\
+				 R_xlen_t lo, R_xlen_t hi, double* out);	\
+  void flattening_1tom_##ISA(bool thomas, double xlon, double xlat,	\
+			     const double* ylon, const double* ylat,	\
+			     R_xlen_t n, double* out);			\
+  void flattening_pairs_##ISA(bool thomas,				\
+			      const double* xlon, const double* xlat,	\
+			      const double* ylon, const double* ylat,	\
+			      R_xlen_t n, double* out);			\
+  void flattening_prep_1tom_##ISA(bool thomas,				\
+				  const PointSet& x, R_xlen_t i,	\
+				  const PointSet& y, R_xlen_t lo,	\
+				  R_xlen_t hi, double* out);		\
+  void flattening_prep_pairs_##ISA(bool thomas,				\
+				   const PointSet& x, const PointSet& y, \
+				   R_xlen_t lo, R_xlen_t hi, double* out); \
+  void planar_1tom_##ISA(bool manhattan, double xlon, double xlat,	\
+			 const double* ylon, const double* ylat,	\
+			 R_xlen_t n, double* out);			\
+  void planar_pairs_##ISA(bool manhattan,				\
+			  const double* xlon, const double* xlat,	\
+			  const double* ylon, const double* ylat,	\
+			  R_xlen_t n, double* out);			\
+  void fast_1tom_##ISA(double xlon, double xlat,			\
+		       const double* ylon, const double* ylat,		\
+		       R_xlen_t n, double* out);			\
+  void fast_pairs_##ISA(const double* xlon, const double* xlat,	\
+			const double* ylon, const double* ylat,		\
+			R_xlen_t n, double* out);			\
+  void fast_prep_1tom_##ISA(const PointSet& x, R_xlen_t i,		\
+			    const PointSet& y, R_xlen_t lo,		\
+			    R_xlen_t hi, double* out);			\
+  void fast_prep_pairs_##ISA(const PointSet& x, const PointSet& y,	\
+			     R_xlen_t lo, R_xlen_t hi, double* out);
+
+SIMD_DECLARE(avx2)
+SIMD_DECLARE(avx512)
+
+// x86-64 builds with GCC or clang get AVX2 / AVX-512 kernels. They are
+// left out on Windows, where the toolchain does not align the stack for
+// 32- and 64-byte spills.
+#if (defined(__x86_64__) || defined(_M_X64)) && \
+  (defined(__GNUC__) || defined(__clang__)) && !defined(_WIN32)
+#define DISTRCPP_X86_SIMD 1
+#endif
+
+#endif
@@ -0,0 +1,1337 @@
+
+// simd_math.h
+//
+// Vectorised elementary functions and batch distance kernels written
+// against a "pack" of doubles. Each instruction set gets its own
+// translation unit that defines a pack type P and SIMD_INLINE (carrying
+// the matching target attribute) and then includes this file, so nothing
+// here is compiled for an instruction set the CPU has not been checked
+// for. There is deliberately no include guard.
+//
+// A pack type provides
+//   typedef V (vector of W doubles), typedef M (lane mask), W
+//   load, store, set1, add, sub, mul, div, sqrt, lt, gt, eq, sel, neg
+//
+// Accuracy: the polynomials are the fdlibm kernels. sin/cos are within
+// 1 ulp on the reduced range and asin within 2 ulp on [0, 1].
+
+// ----------------------------------------------------------------------------
+// constants
+// ----------------------------------------------------------------------------
+
+#define SM_INVPIO2 6.36619772367581382433e-01
+#define SM_PIO2_1  1.57079632673412561417e+00
+#define SM_PIO2_2  6.07710050630396597660e-11
+#define SM_PIO2_3  2.02226624871116645580e-21
+#define SM_PIO2_HI 1.57079632679489655800e+00
+#define SM_PIO2_LO 6.12323399573676603587e-17
+#define SM_ROUND   6755399441055744.0
+
+// ----------------------------------------------------------------------------
+// helpers
+// ----------------------------------------------------------------------------
+
+// round to nearest (ties to even) for |x| < 2^51
+template <class P>
+SIMD_INLINE typename P::V sm_round(typename P::V x) {
+  typename P::V m = P::set1(SM_ROUND);
+  return P::sub(P::add(x, m), m);
+}
+
+template <class P>
+SIMD_INLINE typename P::V sm_floor(typename P::V x) {
+  typename P::V r = sm_round<P>(x);
+  return P::sel(P::gt(r, x), P::sub(r, P::set1(1.0)), r);
+}
+
+// sine and cosine of x, both at once
+template <class P>
+SIMD_INLINE void sm_sincos(typename P::V x,
+			   typename P::V& s,
+			   typename P::V& c) {
+
+  typedef typename P::V V;
+
+  // reduce to r in [-pi/4, pi/4], x = r + q * pi/2
+  V q = sm_round<P>(P::mul(x, P::set1(SM_INVPIO2)));
+  V r = P::sub(x, P::mul(q, P::set1(SM_PIO2_1)));
+  r = P::sub(r, P::mul(q, P::set1(SM_PIO2_2)));
+  r = P::sub(r, P::mul(q, P::set1(SM_PIO2_3)));
+
+  V z = P::mul(r, r);
+
+  // sin(r)
+  V ps = P::set1(1.58969099521155010221e-10);
+  ps = P::add(P::mul(ps, z), P::set1(-2.50507602534068634195e-08));
+  ps = P::add(P::mul(ps, z), P::set1(2.75573137070700676789e-06));
+  ps = P::add(P::mul(ps, z), P::set1(-1.98412698298579493134e-04));
+  ps = P::add(P::mul(ps, z), P::set1(8.33333333332248946124e-03));
+  ps = P::add(P::mul(ps, z), P::set1(-1.66666666666666324348e-01));
+  V sr = P::add(r, P::mul(P::mul(r, z), ps));
+
+  // cos(r)
+  V pc = P::set1(-1.13596475577881948265e-11);
+  pc = P::add(P::mul(pc, z), P::set1(2.08757232129817482790e-09));
+  pc = P::add(P::mul(pc, z), P::set1(-2.75573143513906633035e-07));
+  pc = P::add(P::mul(pc, z), P::set1(2.48015872894767294178e-05));
+  pc = P::add(P::mul(pc, z), P::set1(-1.38888888888741095749e-03));
+  pc = P::add(P::mul(pc, z), P::set1(4.16666666666666019037e-02));
+  V cr = P::add(P::sub(P::set1(1.0), P::mul(P::set1(0.5), z)),
+		P::mul(P::mul(z, z), pc));
+
+  // quadrant in 0..3
+  V qm = P::sub(q, P::mul(P::set1(4.0), sm_floor<P>(P::mul(q, P::set1(0.25)))));
+
+  typename P::M q1 = P::eq(qm, P::set1(1.0));
+  typename P::M q2 = P::eq(qm, P::set1(2.0));
+  typename P::M q3 = P::eq(qm, P::set1(3.0));
+
+  // sin: s, c, -s, -c; cos: c, -s, -c, s
+  s = P::sel(q1, cr, P::sel(q2, P::neg(sr), P::sel(q3, P::neg(cr), sr)));
+  c = P::sel(q1, P::neg(sr), P::sel(q2, P::neg(cr), P::sel(q3, sr, cr)));
+
+}
+
+template <class P>
+SIMD_INLINE typename P::V sm_sin(typename P::V x) {
+  typename P::V s, c;
+  sm_sincos<P>(x, s, c);
+  return s;
+}
+
+template <class P>
+SIMD_INLINE typename P::V sm_cos(typename P::V x) {
+  typename P::V s, c;
+  sm_sincos<P>(x, s, c);
+  return c;
+}
+
+// rational approximation used by asin: asin(x) ~ x + x * R(x^2)
+template <class P>
+SIMD_INLINE typename P::V sm_asin_r(typename P::V t) {
+
+  typedef typename P::V V;
+
+  V p = P::set1(3.47933107596021167570e-05);
+  p = P::add(P::mul(p, t), P::set1(7.91534994289814532176e-04));
+  p = P::add(P::mul(p, t), P::set1(-4.00555345006794114027e-02));
+  p = P::add(P::mul(p, t), P::set1(2.01212532134862925881e-01));
+  p = P::add(P::mul(p, t), P::set1(-3.25565818622400915405e-01));
+  p = P::add(P::mul(p, t), P::set1(1.66666666666666657415e-01));
+  p = P::mul(p, t);
+
+  V q = P::set1(7.70381505559019352791e-02);
+  q = P::add(P::mul(q, t), P::set1(-6.88283971605453293030e-01));
+  q = P::add(P::mul(q, t), P::set1(2.02094576023350569471e+00));
+  q = P::add(P::mul(q, t), P::set1(-2.40339491173441421878e+00));
+  q = P::add(P::mul(q, t), P::set1(1.0));
+
+  return P::div(p, q);
+
+}
+
+// arcsine for x in [0, 1]
+template <class P>
+SIMD_INLINE typename P::V sm_asin01(typename P::V x) {
+
+  typedef typename P::V V;
+
+  // |x| < 0.5: direct
+  V lo = P::add(x, P::mul(x, sm_asin_r<P>(P::mul(x, x))));
+
+  // |x| >= 0.5: asin(x) = pi/2 - 2 asin(sqrt((1 - x) / 2))
+  V t = P::mul(P::sub(P::set1(1.0), x), P::set1(0.5));
+  V s = P::sqrt(t);
+  V hi = P::sub(P::set1(SM_PIO2_HI),
+		P::sub(P::mul(P::set1(2.0), P::add(s, P::mul(s, sm_asin_r<P>(t)))),
+		       P::set1(SM_PIO2_LO)));
+
+  return P::sel(P::lt(x, P::set1(0.5)), lo, hi);
+
+}
+
+// ----------------------------------------------------------------------------
+// Haversine
+// ----------------------------------------------------------------------------
+
+// Haversine distance in meters from one pack of starting points to one
+// pack of ending points, all in degrees; cxlat is cos(xlat) in radians.
+// Operations follow dist_haversine() in the same order.
+template <class P>
+SIMD_INLINE typename P::V sm_haversine(typename P::V xlon,
+				       typename P::V xlat,
+				       typename P::V cxlat,
+				       typename P::V ylon,
+				       typename P::V ylat) {
+
+  typedef typename P::V V;
+
+  V pi = P::set1(M_PI);
+  V d180 = P::set1(180.);
+  V half = P::set1(2.);
+
+  V xlonr = P::div(P::mul(xlon, pi), d180);
+  V xlatr = P::div(P::mul(xlat, pi), d180);
+  V ylonr = P::div(P::mul(ylon, pi), d180);
+  V ylatr = P::div(P::mul(ylat, pi), d180);
+
+  V d1 = sm_sin<P>(P::div(P::sub(ylatr, xlatr), half));
+  V d2 = sm_sin<P>(P::div(P::sub(ylonr, xlonr), half));
+
+  V h = P::add(P::mul(d1, d1),
+	       P::mul(P::mul(P::mul(cxlat, sm_cos<P>(ylatr)), d2), d2));
+
+  return P::mul(P::set1(2.0 * a), sm_asin01<P>(P::sqrt(h)));
+
+}
+
+// one starting point to n ending points
+template <class P>
+SIMD_INLINE void sm_haversine_1tom(double xlon,
+				   double xlat,
+				   const double* ylon,
+				   const double* ylat,
+				   R_xlen_t n,
+				   double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V xlo = P::set1(xlon);
+  V xla = P::set1(xlat);
+  V cx = P::set1(cos(deg_to_rad(xlat)));
+
+  R_xlen_t i = 0;
+  for (; i + W <= n; i += W) {
+    P::store(out + i, sm_haversine<P>(xlo, xla, cx,
+				      P::load(ylon + i), P::load(ylat + i)));
+  }
+
+  // remainder through a padded pack
+  if (i < n) {
+    double tlon[W], tlat[W], tout[W];
+    for (int l = 0; l < W; l++) {
+      tlon[l] = (i + l < n) ? ylon[i + l] : xlon;
+      tlat[l] = (i + l < n) ? ylat[i + l] : xlat;
+    }
+    P::store(tout, sm_haversine<P>(xlo, xla, cx,
+				   P::load(tlon), P::load(tlat)));
+    for (int l = 0; i + l < n; l++)
+      out[i + l] = tout[l];
+  }
+}
+
+// n corresponding pairs of starting and ending points
+template <class P>
+SIMD_INLINE void sm_haversine_pairs(const double* xlon,
+				    const double* xlat,
+				    const double* ylon,
+				    const double* ylat,
+				    R_xlen_t n,
+				    double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+  V pi = P::set1(M_PI);
+  V d180 = P::set1(180.);
+
+  R_xlen_t i = 0;
+  for (; i + W <= n; i += W) {
+    V xla = P::load(xlat + i);
+    V cx = sm_cos<P>(P::div(P::mul(xla, pi), d180));
+    P::store(out + i, sm_haversine<P>(P::load(xlon + i), xla, cx,
+				      P::load(ylon + i), P::load(ylat + i)));
+  }
+
+  // remainder through a padded pack
+  if (i < n) {
+    double t[4][W], tout[W];
+    for (int l = 0; l < W; l++) {
+      bool in = (i + l < n);
+      t[0][l] = in ? xlon[i + l] : 0;
+      t[1][l] = in ? xlat[i + l] : 0;
+      t[2][l] = in ? ylon[i + l] : 0;
+      t[3][l] = in ? ylat[i + l] : 0;
+    }
+    V xla = P::load(t[1]);
+    V cx = sm_cos<P>(P::div(P::mul(xla, pi), d180));
+    P::store(tout, sm_haversine<P>(P::load(t[0]), xla, cx,
+				   P::load(t[2]), P::load(t[3])));
+    for (int l = 0; i + l < n; l++)
+      out[i + l] = tout[l];
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Vincenty
+// ----------------------------------------------------------------------------
+
+// pairs per setup chunk
+#define SM_VINCENTY_CHUNK 256
+
+// Convergence test on |lambda - lambdaOld| as in dist_vincenty(). Lanes
+// and the scalar solver round differently, so when the change in lambda
+// lands within SM_VINCENTY_SLACK of the tolerance the two might stop one
+// iteration apart, which moves the distance by up to b * 1e-12 (~6e-6 m).
+// Lanes hand such pairs back to be solved by dist_vincenty(), as they do
+// pairs that contract slowly (ratio of successive changes above
+// SM_VINCENTY_RATIO, nearly antipodal points, where rounding differences
+// build up across iterations) and pairs that do not converge.
+#define SM_VINCENTY_TOL 1.0e-12
+#define SM_VINCENTY_SLACK 1.0e-14
+#define SM_VINCENTY_RATIO 0.1
+#define SM_VINCENTY_ITERS 100
+
+// absolute value
+template <class P>
+SIMD_INLINE typename P::V sm_abs(typename P::V x) {
+  return P::sel(P::lt(x, P::set1(0.0)), P::neg(x), x);
+}
+
+// arctangent for x in [0, 1]
+template <class P>
+SIMD_INLINE typename P::V sm_atan01(typename P::V x) {
+
+  typedef typename P::V V;
+  typedef typename P::M M;
+
+  // reduce: x < 7/16 direct, x < 11/16 about atan(1/2), else about atan(1)
+  M r0 = P::lt(x, P::set1(0.4375));
+  M r1 = P::lt(x, P::set1(0.6875));
+  V one = P::set1(1.0);
+  V two = P::set1(2.0);
+  V x1 = P::div(P::sub(P::mul(two, x), one), P::add(two, x));
+  V x2 = P::div(P::sub(x, one), P::add(x, one));
+  V t = P::sel(r0, x, P::sel(r1, x1, x2));
+  V hi = P::sel(r1, P::set1(4.63647609000806093515e-01),
+		P::set1(7.85398163397448278999e-01));
+  V lo = P::sel(r1, P::set1(2.26987774529616870924e-17),
+		P::set1(3.06161699786838301793e-17));
+
+  V z = P::mul(t, t);
+  V w = P::mul(z, z);
+
+  V s1 = P::set1(1.62858201153657823623e-02);
+  s1 = P::add(P::mul(s1, w), P::set1(4.97687799461593236017e-02));
+  s1 = P::add(P::mul(s1, w), P::set1(6.66107313738753120669e-02));
+  s1 = P::add(P::mul(s1, w), P::set1(9.09088713343650656196e-02));
+  s1 = P::add(P::mul(s1, w), P::set1(1.42857142725034663711e-01));
+  s1 = P::add(P::mul(s1, w), P::set1(3.33333333333329318027e-01));
+  s1 = P::mul(z, s1);
+
+  V s2 = P::set1(-3.65315727442169155270e-02);
+  s2 = P::add(P::mul(s2, w), P::set1(-5.83357013379057348645e-02));
+  s2 = P::add(P::mul(s2, w), P::set1(-7.69187620504482999495e-02));
+  s2 = P::add(P::mul(s2, w), P::set1(-1.11111104054623557880e-01));
+  s2 = P::add(P::mul(s2, w), P::set1(-1.99999999998764832476e-01));
+  s2 = P::mul(w, s2);
+
+  V ts = P::mul(t, P::add(s1, s2));
+  V direct = P::sub(t, ts);
+  V shifted = P::sub(hi, P::sub(P::sub(ts, lo), t));
+
+  return P::sel(r0, direct, shifted);
+
+}
+
+// atan2(y, x) for y >= 0
+template <class P>
+SIMD_INLINE typename P::V sm_atan2_ypos(typename P::V y, typename P::V x) {
+
+  typedef typename P::V V;
+  typedef typename P::M M;
+
+  V zero = P::set1(0.0);
+  V ax = sm_abs<P>(x);
+  M steep = P::gt(y, ax);
+  V num = P::sel(steep, ax, y);
+  V den = P::sel(steep, y, ax);
+  V r = P::sel(P::eq(den, zero), zero, P::div(num, den));
+
+  V t = sm_atan01<P>(r);
+  t = P::sel(steep, P::sub(P::set1(SM_PIO2_HI), P::sub(t, P::set1(SM_PIO2_LO))), t);
+  t = P::sel(P::lt(x, zero),
+	     P::sub(P::set1(2.0 * SM_PIO2_HI), P::sub(t, P::set1(2.0 * SM_PIO2_LO))),
+	     t);
+
+  return t;
+
+}
+
+// longitude in radians and sine / cosine of reduced latitude for n
+// points in degrees: tan(U) = (1 - f) tan(lat)
+template <class P>
+SIMD_INLINE void sm_vincenty_prep(const double* lon,
+				  const double* lat,
+				  R_xlen_t n,
+				  double* lonr,
+				  double* sU,
+				  double* cU) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+  V pi = P::set1(M_PI);
+  V d180 = P::set1(180.);
+  V omf = P::set1(1. - f);
+
+  for (R_xlen_t i = 0; i < n; i += W) {
+
+    // remainder through a padded pack
+    double tlon[W], tlat[W], t[3][W];
+    bool full = (i + W <= n);
+    if (!full) {
+      for (int l = 0; l < W; l++) {
+	tlon[l] = (i + l < n) ? lon[i + l] : 0;
+	tlat[l] = (i + l < n) ? lat[i + l] : 0;
+      }
+    }
+
+    V lo = P::load(full ? lon + i : tlon);
+    V la = P::load(full ? lat + i : tlat);
+    V s, c;
+    sm_sincos<P>(P::div(P::mul(la, pi), d180), s, c);
+    V ts = P::mul(omf, s);
+    V r = P::sqrt(P::add(P::mul(ts, ts), P::mul(c, c)));
+
+    P::store(full ? lonr + i : t[0], P::div(P::mul(lo, pi), d180));
+    P::store(full ? sU + i : t[1], P::div(ts, r));
+    P::store(full ? cU + i : t[2], P::div(c, r));
+
+    if (!full) {
+      for (int l = 0; i + l < n; l++) {
+	lonr[i + l] = t[0][l];
+	sU[i + l] = t[1][l];
+	cU[i + l] = t[2][l];
+      }
+    }
+  }
+}
+
+// Vincenty distances for n prepared pairs. Each lane iterates its own
+// pair; when a lane converges its distance is written out and the lane
+// is refilled with the next pair, so one slow pair does not hold up the
+// others. Iteration and convergence test follow dist_vincenty(). Returns
+// the number of pairs left for the scalar solver, listed in slow.
+template <class P>
+SIMD_INLINE int sm_vincenty_lanes(const double* sU1,
+				  const double* cU1,
+				  const double* sU2,
+				  const double* cU2,
+				  const double* L,
+				  int n,
+				  double* out,
+				  int* slow) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  // lane state
+  double ls1[W], lc1[W], ls2[W], lc2[W], lL[W], llam[W], lnew[W], ldist[W];
+  double ldl[W];
+  int idx[W], iters[W];
+  int next = 0;
+  int active = 0;
+  int nslow = 0;
+
+  for (int l = 0; l < W; l++) {
+    if (next < n) {
+      idx[l] = next;
+      ls1[l] = sU1[next]; lc1[l] = cU1[next];
+      ls2[l] = sU2[next]; lc2[l] = cU2[next];
+      lL[l] = llam[l] = L[next];
+      ldl[l] = 0;
+      iters[l] = SM_VINCENTY_ITERS;
+      next++;
+      active++;
+    } else {
+      // idle lane on a harmless pair
+      idx[l] = -1;
+      ls1[l] = 0; lc1[l] = 1; ls2[l] = 0.6; lc2[l] = 0.8;
+      lL[l] = llam[l] = 0.5;
+    }
+  }
+
+  V one = P::set1(1.0);
+  V two = P::set1(2.0);
+  V vf = P::set1(f);
+  V usq_scale = P::set1((a * a - b * b) / ((b) * (b)));
+
+  while (active > 0) {
+
+    V s1 = P::load(ls1);
+    V c1 = P::load(lc1);
+    V s2 = P::load(ls2);
+    V c2 = P::load(lc2);
+    V lam = P::load(llam);
+
+    V sinLambda, cosLambda;
+    sm_sincos<P>(lam, sinLambda, cosLambda);
+
+    V p1 = P::mul(c2, sinLambda);
+    V p2 = P::sub(P::mul(c1, s2), P::mul(P::mul(s1, c2), cosLambda));
+
+    V sinsig = P::sqrt(P::add(P::mul(p1, p1), P::mul(p2, p2)));
+    V cossig = P::add(P::mul(s1, s2), P::mul(P::mul(c1, c2), cosLambda));
+
+    V sigma = sm_atan2_ypos<P>(sinsig, cossig);
+
+    V sina = P::div(P::mul(P::mul(c1, c2), sinLambda), sinsig);
+    V cos2a = P::sub(one, P::mul(sina, sina));
+    V cos2sigm = P::sub(cossig, P::div(P::mul(P::mul(two, s1), s2), cos2a));
+
+    V C = P::mul(P::mul(P::set1(f / 16.), cos2a),
+		 P::add(P::set1(4.),
+			P::mul(vf, P::sub(P::set1(4.), P::mul(P::set1(3.), cos2a)))));
+
+    // -1 + 2 cos^2(2 sigma_m)
+    V c2s = P::add(P::set1(-1.), P::mul(P::mul(two, cos2sigm), cos2sigm));
+
+    V lamNew = P::add(P::load(lL),
+		      P::mul(P::mul(P::mul(P::sub(one, C), vf), sina),
+			     P::add(sigma,
+				    P::mul(P::mul(C, sinsig),
+					   P::add(cos2sigm, P::mul(P::mul(C, cossig), c2s))))));
+
+    // distance from this iteration, kept if the lane has converged
+    V Usq = P::mul(cos2a, usq_scale);
+    V A = P::add(one, P::mul(P::div(Usq, P::set1(16384.)),
+			     P::add(P::set1(4096.),
+				    P::mul(Usq, P::add(P::set1(-768.),
+						       P::mul(Usq, P::sub(P::set1(320.),
+									  P::mul(P::set1(175.), Usq))))))));
+    V B = P::mul(P::div(Usq, P::set1(1024.)),
+		 P::add(P::set1(256.),
+			P::mul(Usq, P::add(P::set1(-128.),
+					   P::mul(Usq, P::sub(P::set1(74.),
+							      P::mul(P::set1(47.), Usq)))))));
+    V t1 = P::mul(cossig, c2s);
+    V t2 = P::mul(P::mul(P::mul(P::div(B, P::set1(6.)), cos2sigm),
+			 P::add(P::set1(-3.), P::mul(P::mul(P::set1(4.), sinsig), sinsig))),
+		  P::add(P::set1(-3.), P::mul(P::mul(P::set1(4.), cos2sigm), cos2sigm)));
+    V dsigma = P::mul(P::mul(B, sinsig),
+		      P::add(cos2sigm, P::mul(P::div(B, P::set1(4.)), P::sub(t1, t2))));
+    V dist = P::mul(P::mul(P::set1(b), A), P::sub(sigma, dsigma));
+
+    P::store(lnew, lamNew);
+    P::store(ldist, dist);
+
+    // retire converged lanes and refill them
+    for (int l = 0; l < W; l++) {
+
+      if (idx[l] < 0) continue;
+
+      iters[l] -= 1;
+
+      double dl = fabs(lnew[l] - llam[l]);
+      bool near_tol = (fabs(dl - SM_VINCENTY_TOL) <= SM_VINCENTY_SLACK);
+
+      if (dl > SM_VINCENTY_TOL && iters[l] > 0 && !near_tol) {
+	llam[l] = lnew[l];
+	ldl[l] = dl;
+	continue;
+      }
+
+      // first iteration has no ratio
+      bool settled = (iters[l] > 0 && !near_tol &&
+		      (ldl[l] == 0 || dl <= SM_VINCENTY_RATIO * ldl[l]));
+
+      if (settled)
+	out[idx[l]] = ldist[l];
+      else
+	slow[nslow++] = idx[l];
+
+      if (next < n) {
+	idx[l] = next;
+	ls1[l] = sU1[next]; lc1[l] = cU1[next];
+	ls2[l] = sU2[next]; lc2[l] = cU2[next];
+	lL[l] = llam[l] = L[next];
+	ldl[l] = 0;
+	iters[l] = SM_VINCENTY_ITERS;
+	next++;
+      } else {
+	idx[l] = -1;
+	active--;
+      }
+    }
+  }
+
+  return nslow;
+
+}
+
+// one starting point to n ending points
+template <class P>
+SIMD_INLINE void sm_vincenty_1tom(double xlon,
+				  double xlat,
+				  const double* ylon,
+				  const double* ylat,
+				  R_xlen_t n,
+				  double* out) {
+
+  const int CH = SM_VINCENTY_CHUNK;
+  double xlonr, sx, cx;
+  double s1[CH], c1[CH], s2[CH], c2[CH], L[CH];
+  int slow[CH];
+
+  sm_vincenty_prep<P>(&xlon, &xlat, 1, &xlonr, &sx, &cx);
+  for (int l = 0; l < CH; l++) {
+    s1[l] = sx;
+    c1[l] = cx;
+  }
+
+  for (R_xlen_t i = 0; i < n; i += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, n - i);
+
+    sm_vincenty_prep<P>(ylon + i, ylat + i, m, L, s2, c2);
+    for (int l = 0; l < m; l++)
+      L[l] -= xlonr;
+
+    int nslow = sm_vincenty_lanes<P>(s1, c1, s2, c2, L, m, out + i, slow);
+    for (int l = 0; l < nslow; l++) {
+      R_xlen_t j = i + slow[l];
+      out[j] = dist_vincenty(xlon, xlat, ylon[j], ylat[j]);
+    }
+
+    // same point
+    for (int l = 0; l < m; l++) {
+      if (xlon == ylon[i + l] && xlat == ylat[i + l]) out[i + l] = 0;
+    }
+  }
+}
+
+// n corresponding pairs of starting and ending points
+template <class P>
+SIMD_INLINE void sm_vincenty_pairs(const double* xlon,
+				   const double* xlat,
+				   const double* ylon,
+				   const double* ylat,
+				   R_xlen_t n,
+				   double* out) {
+
+  const int CH = SM_VINCENTY_CHUNK;
+  double xr[CH], s1[CH], c1[CH], s2[CH], c2[CH], L[CH];
+  int slow[CH];
+
+  for (R_xlen_t i = 0; i < n; i += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, n - i);
+
+    sm_vincenty_prep<P>(xlon + i, xlat + i, m, xr, s1, c1);
+    sm_vincenty_prep<P>(ylon + i, ylat + i, m, L, s2, c2);
+    for (int l = 0; l < m; l++)
+      L[l] -= xr[l];
+
+    int nslow = sm_vincenty_lanes<P>(s1, c1, s2, c2, L, m, out + i, slow);
+    for (int l = 0; l < nslow; l++) {
+      R_xlen_t j = i + slow[l];
+      out[j] = dist_vincenty(xlon[j], xlat[j], ylon[j], ylat[j]);
+    }
+
+    // same point
+    for (int l = 0; l < m; l++) {
+      if (xlon[i + l] == ylon[i + l] && xlat[i + l] == ylat[i + l])
+	out[i + l] = 0;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// prepared point sets
+// ----------------------------------------------------------------------------
+
+// load / store the first m <= W values of p
+template <class P>
+SIMD_INLINE typename P::V sm_load_n(const double* p, int m) {
+  if (m == P::W) return P::load(p);
+  double t[P::W];
+  for (int l = 0; l < P::W; l++) t[l] = (l < m) ? p[l] : 0;
+  return P::load(t);
+}
+
+template <class P>
+SIMD_INLINE void sm_store_n(double* p, typename P::V x, int m) {
+  if (m == P::W) {
+    P::store(p, x);
+    return;
+  }
+  double t[P::W];
+  P::store(t, x);
+  for (int l = 0; l < m; l++) p[l] = t[l];
+}
+
+// Haversine distance between packs of prepared points: sin(delta / 2) by
+// the difference formula, as in KernelHaversine::prep()
+template <class P>
+SIMD_INLINE typename P::V sm_haversine_prep(typename P::V shlat1,
+					    typename P::V chlat1,
+					    typename P::V shlon1,
+					    typename P::V chlon1,
+					    typename P::V clat1,
+					    typename P::V shlat2,
+					    typename P::V chlat2,
+					    typename P::V shlon2,
+					    typename P::V chlon2,
+					    typename P::V clat2) {
+
+  typedef typename P::V V;
+
+  V d1 = P::sub(P::mul(shlat2, chlat1), P::mul(chlat2, shlat1));
+  V d2 = P::sub(P::mul(shlon2, chlon1), P::mul(chlon2, shlon1));
+
+  // rounding can push antipodal points just past 1
+  V one = P::set1(1.0);
+  V h = P::add(P::mul(d1, d1), P::mul(P::mul(P::mul(clat1, clat2), d2), d2));
+  h = P::sel(P::gt(h, one), one, h);
+
+  return P::mul(P::set1(2.0 * a), sm_asin01<P>(P::sqrt(h)));
+
+}
+
+// zero where both coordinates match, as the scalar kernels do
+template <class P>
+SIMD_INLINE typename P::V sm_same_zero(typename P::V d,
+				       typename P::V lon1,
+				       typename P::V lat1,
+				       typename P::V lon2,
+				       typename P::V lat2) {
+  typename P::V zero = P::set1(0.0);
+  return P::sel(P::eq(lon1, lon2), P::sel(P::eq(lat1, lat2), zero, d), d);
+}
+
+// point i of x to points [lo, hi) of y
+template <class P>
+SIMD_INLINE void sm_haversine_prep_1tom(const PointSet& x,
+					R_xlen_t i,
+					const PointSet& y,
+					R_xlen_t lo,
+					R_xlen_t hi,
+					double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V shlat1 = P::set1(x.shlat[i]);
+  V chlat1 = P::set1(x.chlat[i]);
+  V shlon1 = P::set1(x.shlon[i]);
+  V chlon1 = P::set1(x.chlon[i]);
+  V clat1 = P::set1(x.clat[i]);
+  V lon1 = P::set1(x.lon[i]);
+  V lat1 = P::set1(x.lat[i]);
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V d = sm_haversine_prep<P>(shlat1, chlat1, shlon1, chlon1, clat1,
+			       sm_load_n<P>(y.shlat + j, m),
+			       sm_load_n<P>(y.chlat + j, m),
+			       sm_load_n<P>(y.shlon + j, m),
+			       sm_load_n<P>(y.chlon + j, m),
+			       sm_load_n<P>(y.clat + j, m));
+    d = sm_same_zero<P>(d, lon1, lat1,
+			sm_load_n<P>(y.lon + j, m), sm_load_n<P>(y.lat + j, m));
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
+
+// corresponding points [lo, hi) of x and y
+template <class P>
+SIMD_INLINE void sm_haversine_prep_pairs(const PointSet& x,
+					 const PointSet& y,
+					 R_xlen_t lo,
+					 R_xlen_t hi,
+					 double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V d = sm_haversine_prep<P>(sm_load_n<P>(x.shlat + j, m),
+			       sm_load_n<P>(x.chlat + j, m),
+			       sm_load_n<P>(x.shlon + j, m),
+			       sm_load_n<P>(x.chlon + j, m),
+			       sm_load_n<P>(x.clat + j, m),
+			       sm_load_n<P>(y.shlat + j, m),
+			       sm_load_n<P>(y.chlat + j, m),
+			       sm_load_n<P>(y.shlon + j, m),
+			       sm_load_n<P>(y.chlon + j, m),
+			       sm_load_n<P>(y.clat + j, m));
+    d = sm_same_zero<P>(d,
+			sm_load_n<P>(x.lon + j, m), sm_load_n<P>(x.lat + j, m),
+			sm_load_n<P>(y.lon + j, m), sm_load_n<P>(y.lat + j, m));
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
+
+// point i of x to points [lo, hi) of y
+template <class P>
+SIMD_INLINE void sm_vincenty_prep_1tom(const PointSet& x,
+				       R_xlen_t i,
+				       const PointSet& y,
+				       R_xlen_t lo,
+				       R_xlen_t hi,
+				       double* out) {
+
+  const int CH = SM_VINCENTY_CHUNK;
+  double s1[CH], c1[CH], L[CH];
+  int slow[CH];
+
+  for (int l = 0; l < CH; l++) {
+    s1[l] = x.sU[i];
+    c1[l] = x.cU[i];
+  }
+
+  for (R_xlen_t j0 = lo; j0 < hi; j0 += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, hi - j0);
+    double* o = out + (j0 - lo);
+
+    for (int l = 0; l < m; l++)
+      L[l] = y.lonr[j0 + l] - x.lonr[i];
+
+    int nslow = sm_vincenty_lanes<P>(s1, c1, y.sU + j0, y.cU + j0, L, m,
+				     o, slow);
+    for (int l = 0; l < nslow; l++)
+      o[slow[l]] = KernelVincenty::prep(x, i, y, j0 + slow[l]);
+
+    // same point
+    for (int l = 0; l < m; l++) {
+      if (x.lon[i] == y.lon[j0 + l] && x.lat[i] == y.lat[j0 + l]) o[l] = 0;
+    }
+  }
+}
+
+// corresponding points [lo, hi) of x and y
+template <class P>
+SIMD_INLINE void sm_vincenty_prep_pairs(const PointSet& x,
+					const PointSet& y,
+					R_xlen_t lo,
+					R_xlen_t hi,
+					double* out) {
+
+  const int CH = SM_VINCENTY_CHUNK;
+  double L[CH];
+  int slow[CH];
+
+  for (R_xlen_t j0 = lo; j0 < hi; j0 += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, hi - j0);
+    double* o = out + (j0 - lo);
+
+    for (int l = 0; l < m; l++)
+      L[l] = y.lonr[j0 + l] - x.lonr[j0 + l];
+
+    int nslow = sm_vincenty_lanes<P>(x.sU + j0, x.cU + j0,
+				     y.sU + j0, y.cU + j0, L, m, o, slow);
+    for (int l = 0; l < nslow; l++)
+      o[slow[l]] = KernelVincenty::prep(x, j0 + slow[l], y, j0 + slow[l]);
+
+    // same point
+    for (int l = 0; l < m; l++) {
+      R_xlen_t j = j0 + l;
+      if (x.lon[j] == y.lon[j] && x.lat[j] == y.lat[j]) o[l] = 0;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Andoyer-Lambert and Thomas
+// ----------------------------------------------------------------------------
+
+// pairs per setup chunk
+#define SM_FLATTENING_CHUNK 256
+
+// Andoyer-Lambert or (if thomas) Thomas distances between packs of
+// points given by the sines and cosines of their reduced latitudes and
+// sin(dlon / 2). Operations follow flattening_series() in kernels.h.
+template <class P>
+SIMD_INLINE typename P::V sm_flattening(bool thomas,
+					typename P::V sU1,
+					typename P::V cU1,
+					typename P::V sU2,
+					typename P::V cU2,
+					typename P::V sdl) {
+
+  typedef typename P::V V;
+
+  V zero = P::set1(0.0);
+  V one = P::set1(1.0);
+  V two = P::set1(2.0);
+
+  V s = P::sub(P::mul(sU2, cU1), P::mul(cU2, sU1));
+  V c = P::add(P::mul(cU1, cU2), P::mul(sU1, sU2));
+  V h = P::sel(P::lt(c, zero),
+	       P::div(P::sub(one, c), two),
+	       P::div(P::mul(s, s), P::mul(two, P::add(one, c))));
+  h = P::add(h, P::mul(P::mul(P::mul(cU1, cU2), sdl), sdl));
+  h = P::sel(P::gt(h, one), one, h);
+
+  V sig = P::mul(two, sm_asin01<P>(P::sqrt(h)));
+  V ssig = P::mul(two, P::sqrt(P::mul(h, P::sub(one, h))));
+
+  V p = P::add(sU1, sU2);
+  V q = P::sub(sU2, sU1);
+  V X = P::sel(P::lt(h, one),
+	       P::div(P::mul(p, p), P::mul(two, P::sub(one, h))), zero);
+  V Y = P::sel(P::gt(h, zero),
+	       P::div(P::mul(q, q), P::mul(two, h)), zero);
+
+  V first = P::mul(P::set1(a),
+		   P::sub(sig, P::mul(P::set1(f / 4.),
+				      P::add(P::mul(P::sub(sig, ssig), X),
+					     P::mul(P::add(sig, ssig), Y)))));
+  if (!thomas)
+    return first;
+
+  V T = P::div(sig, ssig);
+  V D = P::mul(P::mul(P::set1(4.0), T), T);
+  V E = P::mul(two, P::sub(one, P::mul(two, h)));
+  V A = P::mul(D, E);
+  V C = P::sub(T, P::div(P::sub(A, E), two));
+  V XpY = P::add(X, Y);
+  V XmY = P::sub(X, Y);
+
+  V d1 = P::mul(P::set1(f / 4.), P::sub(P::mul(T, XpY), XmY));
+  V d2 = P::mul(P::set1(f * f / 64.),
+		P::add(P::sub(P::mul(XpY, P::add(A, P::mul(C, XpY))),
+			      P::mul(XmY, P::add(P::mul(two, D),
+						 P::mul(E, XmY)))),
+		       P::mul(P::mul(D, XpY), XmY)));
+
+  V second = P::mul(P::mul(P::set1(a), ssig),
+		    P::add(P::sub(T, d1), d2));
+
+  return P::sel(P::gt(ssig, zero), second, first);
+
+}
+
+// one starting point to n ending points
+template <class P>
+SIMD_INLINE void sm_flattening_1tom(bool thomas,
+				    double xlon,
+				    double xlat,
+				    const double* ylon,
+				    const double* ylat,
+				    R_xlen_t n,
+				    double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+  const int CH = SM_FLATTENING_CHUNK;
+  double xlonr, sx, cx;
+  double L[CH], s2[CH], c2[CH];
+
+  sm_vincenty_prep<P>(&xlon, &xlat, 1, &xlonr, &sx, &cx);
+
+  V lonr1 = P::set1(xlonr);
+  V sU1 = P::set1(sx);
+  V cU1 = P::set1(cx);
+  V lon1 = P::set1(xlon);
+  V lat1 = P::set1(xlat);
+  V two = P::set1(2.0);
+
+  for (R_xlen_t i = 0; i < n; i += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, n - i);
+    sm_vincenty_prep<P>(ylon + i, ylat + i, m, L, s2, c2);
+
+    for (int l = 0; l < m; l += W) {
+      int k = std::min(W, m - l);
+      V sdl = sm_sin<P>(P::div(P::sub(sm_load_n<P>(L + l, k), lonr1), two));
+      V d = sm_flattening<P>(thomas, sU1, cU1, sm_load_n<P>(s2 + l, k),
+			     sm_load_n<P>(c2 + l, k), sdl);
+      d = sm_same_zero<P>(d, lon1, lat1, sm_load_n<P>(ylon + i + l, k),
+			  sm_load_n<P>(ylat + i + l, k));
+      sm_store_n<P>(out + i + l, d, k);
+    }
+  }
+}
+
+// n corresponding pairs of starting and ending points
+template <class P>
+SIMD_INLINE void sm_flattening_pairs(bool thomas,
+				     const double* xlon,
+				     const double* xlat,
+				     const double* ylon,
+				     const double* ylat,
+				     R_xlen_t n,
+				     double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+  const int CH = SM_FLATTENING_CHUNK;
+  double xr[CH], s1[CH], c1[CH], L[CH], s2[CH], c2[CH];
+  V two = P::set1(2.0);
+
+  for (R_xlen_t i = 0; i < n; i += CH) {
+
+    int m = (int)std::min((R_xlen_t)CH, n - i);
+    sm_vincenty_prep<P>(xlon + i, xlat + i, m, xr, s1, c1);
+    sm_vincenty_prep<P>(ylon + i, ylat + i, m, L, s2, c2);
+
+    for (int l = 0; l < m; l += W) {
+      int k = std::min(W, m - l);
+      V sdl = sm_sin<P>(P::div(P::sub(sm_load_n<P>(L + l, k),
+				      sm_load_n<P>(xr + l, k)), two));
+      V d = sm_flattening<P>(thomas, sm_load_n<P>(s1 + l, k),
+			     sm_load_n<P>(c1 + l, k),
+			     sm_load_n<P>(s2 + l, k),
+			     sm_load_n<P>(c2 + l, k), sdl);
+      d = sm_same_zero<P>(d,
+			  sm_load_n<P>(xlon + i + l, k),
+			  sm_load_n<P>(xlat + i + l, k),
+			  sm_load_n<P>(ylon + i + l, k),
+			  sm_load_n<P>(ylat + i + l, k));
+      sm_store_n<P>(out + i + l, d, k);
+    }
+  }
+}
+
+// point i of x to points [lo, hi) of y
+template <class P>
+SIMD_INLINE void sm_flattening_prep_1tom(bool thomas,
+					 const PointSet& x,
+					 R_xlen_t i,
+					 const PointSet& y,
+					 R_xlen_t lo,
+					 R_xlen_t hi,
+					 double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V sU1 = P::set1(x.sU[i]);
+  V cU1 = P::set1(x.cU[i]);
+  V shlon1 = P::set1(x.shlon[i]);
+  V chlon1 = P::set1(x.chlon[i]);
+  V lon1 = P::set1(x.lon[i]);
+  V lat1 = P::set1(x.lat[i]);
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V sdl = P::sub(P::mul(sm_load_n<P>(y.shlon + j, m), chlon1),
+		   P::mul(sm_load_n<P>(y.chlon + j, m), shlon1));
+    V d = sm_flattening<P>(thomas, sU1, cU1, sm_load_n<P>(y.sU + j, m),
+			   sm_load_n<P>(y.cU + j, m), sdl);
+    d = sm_same_zero<P>(d, lon1, lat1,
+			sm_load_n<P>(y.lon + j, m), sm_load_n<P>(y.lat + j, m));
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
+
+// corresponding points [lo, hi) of x and y
+template <class P>
+SIMD_INLINE void sm_flattening_prep_pairs(bool thomas,
+					  const PointSet& x,
+					  const PointSet& y,
+					  R_xlen_t lo,
+					  R_xlen_t hi,
+					  double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V sdl = P::sub(P::mul(sm_load_n<P>(y.shlon + j, m),
+			  sm_load_n<P>(x.chlon + j, m)),
+		   P::mul(sm_load_n<P>(y.chlon + j, m),
+			  sm_load_n<P>(x.shlon + j, m)));
+    V d = sm_flattening<P>(thomas, sm_load_n<P>(x.sU + j, m),
+			   sm_load_n<P>(x.cU + j, m),
+			   sm_load_n<P>(y.sU + j, m),
+			   sm_load_n<P>(y.cU + j, m), sdl);
+    d = sm_same_zero<P>(d,
+			sm_load_n<P>(x.lon + j, m), sm_load_n<P>(x.lat + j, m),
+			sm_load_n<P>(y.lon + j, m), sm_load_n<P>(y.lat + j, m));
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Euclidean and Manhattan
+// ----------------------------------------------------------------------------
+
+// Euclidean or (if manhattan) Manhattan distances between packs of
+// projected points, as in KernelPlanar::pair()
+template <class P>
+SIMD_INLINE typename P::V sm_planar(bool manhattan,
+				    typename P::V xlon,
+				    typename P::V xlat,
+				    typename P::V ylon,
+				    typename P::V ylat) {
+
+  typedef typename P::V V;
+
+  V dx = P::sub(ylon, xlon);
+  V dy = P::sub(ylat, xlat);
+
+  if (manhattan)
+    return P::add(sm_abs<P>(dx), sm_abs<P>(dy));
+
+  return P::sqrt(P::add(P::mul(dx, dx), P::mul(dy, dy)));
+
+}
+
+// one starting point to n ending points; prepared sets need nothing but
+// their coordinates, so these serve them too
+template <class P>
+SIMD_INLINE void sm_planar_1tom(bool manhattan,
+				double xlon,
+				double xlat,
+				const double* ylon,
+				const double* ylat,
+				R_xlen_t n,
+				double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V xlo = P::set1(xlon);
+  V xla = P::set1(xlat);
+
+  for (R_xlen_t i = 0; i < n; i += W) {
+    int m = (int)std::min((R_xlen_t)W, n - i);
+    V d = sm_planar<P>(manhattan, xlo, xla, sm_load_n<P>(ylon + i, m),
+		       sm_load_n<P>(ylat + i, m));
+    sm_store_n<P>(out + i, d, m);
+  }
+}
+
+// n corresponding pairs of starting and ending points
+template <class P>
+SIMD_INLINE void sm_planar_pairs(bool manhattan,
+				 const double* xlon,
+				 const double* xlat,
+				 const double* ylon,
+				 const double* ylat,
+				 R_xlen_t n,
+				 double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  for (R_xlen_t i = 0; i < n; i += W) {
+    int m = (int)std::min((R_xlen_t)W, n - i);
+    V d = sm_planar<P>(manhattan,
+		       sm_load_n<P>(xlon + i, m), sm_load_n<P>(xlat + i, m),
+		       sm_load_n<P>(ylon + i, m), sm_load_n<P>(ylat + i, m));
+    sm_store_n<P>(out + i, d, m);
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Fast
+// ----------------------------------------------------------------------------
+
+// Equirectangular distances between packs of points, NaN in lanes that
+// need Haversine; operations follow fast_equirect() in kernels.h
+template <class P>
+SIMD_INLINE typename P::V sm_fast(typename P::V u,
+				  typename P::V v,
+				  typename P::V c) {
+
+  typedef typename P::V V;
+
+  V au = sm_abs<P>(u);
+  V av = sm_abs<P>(v);
+  V excess = P::mul(P::mul(P::mul(P::set1(1.01 * a / 24.), v), v),
+		    P::add(P::mul(P::set1(3.), au),
+			   P::mul(P::mul(c, P::sub(P::set1(1.), P::mul(c, c))),
+				  av)));
+
+  V d = P::mul(P::set1(a),
+	       P::sqrt(P::add(P::mul(u, u),
+			      P::mul(P::mul(P::mul(c, c), v), v))));
+
+  V nan = P::set1(NAN);
+  V span = P::set1(FAST_MAX_SPAN);
+  d = P::sel(P::gt(au, span), nan, d);
+  d = P::sel(P::gt(av, span), nan, d);
+  return P::sel(P::gt(excess, P::set1(FAST_MAX_ERROR)), nan, d);
+
+}
+
+// whether any of the first m lanes of d is NaN
+template <class P>
+SIMD_INLINE bool sm_any_nan(typename P::V d, int m) {
+  double t[P::W];
+  P::store(t, d);
+  for (int l = 0; l < m; l++) {
+    if (t[l] != t[l]) return true;
+  }
+  return false;
+}
+
+// lanes of d that are NaN taken from h
+template <class P>
+SIMD_INLINE typename P::V sm_fill_nan(typename P::V d, typename P::V h) {
+  return P::sel(P::eq(d, d), d, h);
+}
+
+// one starting point to n ending points; Haversine runs only for packs
+// with a lane that needs it
+template <class P>
+SIMD_INLINE void sm_fast_1tom(double xlon,
+			      double xlat,
+			      const double* ylon,
+			      const double* ylat,
+			      R_xlen_t n,
+			      double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V pi = P::set1(M_PI);
+  V d180 = P::set1(180.);
+  V half = P::set1(2.);
+
+  V xlo = P::set1(xlon);
+  V xla = P::set1(xlat);
+  V cx = P::set1(cos(deg_to_rad(xlat)));
+  V xlonr = P::set1(kernel_rad(xlon));
+  V xlatr = P::set1(kernel_rad(xlat));
+
+  for (R_xlen_t i = 0; i < n; i += W) {
+    int m = (int)std::min((R_xlen_t)W, n - i);
+    V ylo = sm_load_n<P>(ylon + i, m);
+    V yla = sm_load_n<P>(ylat + i, m);
+    V ylatr = P::div(P::mul(yla, pi), d180);
+    V ylonr = P::div(P::mul(ylo, pi), d180);
+    V c = sm_cos<P>(P::div(P::add(xlatr, ylatr), half));
+    V d = sm_fast<P>(P::sub(ylatr, xlatr), P::sub(ylonr, xlonr), c);
+    if (sm_any_nan<P>(d, m))
+      d = sm_fill_nan<P>(d, sm_haversine<P>(xlo, xla, cx, ylo, yla));
+    sm_store_n<P>(out + i, d, m);
+  }
+}
+
+// n corresponding pairs of starting and ending points
+template <class P>
+SIMD_INLINE void sm_fast_pairs(const double* xlon,
+			       const double* xlat,
+			       const double* ylon,
+			       const double* ylat,
+			       R_xlen_t n,
+			       double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V pi = P::set1(M_PI);
+  V d180 = P::set1(180.);
+  V half = P::set1(2.);
+
+  for (R_xlen_t i = 0; i < n; i += W) {
+    int m = (int)std::min((R_xlen_t)W, n - i);
+    V xlo = sm_load_n<P>(xlon + i, m);
+    V xla = sm_load_n<P>(xlat + i, m);
+    V ylo = sm_load_n<P>(ylon + i, m);
+    V yla = sm_load_n<P>(ylat + i, m);
+    V xlatr = P::div(P::mul(xla, pi), d180);
+    V ylatr = P::div(P::mul(yla, pi), d180);
+    V dlon = P::sub(P::div(P::mul(ylo, pi), d180),
+		    P::div(P::mul(xlo, pi), d180));
+    V c = sm_cos<P>(P::div(P::add(xlatr, ylatr), half));
+    V d = sm_fast<P>(P::sub(ylatr, xlatr), dlon, c);
+    if (sm_any_nan<P>(d, m))
+      d = sm_fill_nan<P>(d, sm_haversine<P>(xlo, xla, sm_cos<P>(xlatr),
+					    ylo, yla));
+    sm_store_n<P>(out + i, d, m);
+  }
+}
+
+// Equirectangular distances between packs of prepared points, with the
+// cosine of the mean latitude from the half angles as in
+// KernelFast::prep()
+template <class P>
+SIMD_INLINE typename P::V sm_fast_prep(typename P::V latr1,
+				       typename P::V lonr1,
+				       typename P::V shlat1,
+				       typename P::V chlat1,
+				       typename P::V latr2,
+				       typename P::V lonr2,
+				       typename P::V shlat2,
+				       typename P::V chlat2) {
+
+  typename P::V c = P::sub(P::mul(chlat1, chlat2), P::mul(shlat1, shlat2));
+
+  return sm_fast<P>(P::sub(latr2, latr1), P::sub(lonr2, lonr1), c);
+
+}
+
+// point i of x to points [lo, hi) of y
+template <class P>
+SIMD_INLINE void sm_fast_prep_1tom(const PointSet& x,
+				   R_xlen_t i,
+				   const PointSet& y,
+				   R_xlen_t lo,
+				   R_xlen_t hi,
+				   double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  V latr1 = P::set1(x.latr[i]);
+  V lonr1 = P::set1(x.lonr[i]);
+  V shlat1 = P::set1(x.shlat[i]);
+  V chlat1 = P::set1(x.chlat[i]);
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V d = sm_fast_prep<P>(latr1, lonr1, shlat1, chlat1,
+			  sm_load_n<P>(y.latr + j, m),
+			  sm_load_n<P>(y.lonr + j, m),
+			  sm_load_n<P>(y.shlat + j, m),
+			  sm_load_n<P>(y.chlat + j, m));
+    if (sm_any_nan<P>(d, m)) {
+      V h = sm_haversine_prep<P>(shlat1, chlat1, P::set1(x.shlon[i]),
+				 P::set1(x.chlon[i]), P::set1(x.clat[i]),
+				 sm_load_n<P>(y.shlat + j, m),
+				 sm_load_n<P>(y.chlat + j, m),
+				 sm_load_n<P>(y.shlon + j, m),
+				 sm_load_n<P>(y.chlon + j, m),
+				 sm_load_n<P>(y.clat + j, m));
+      d = sm_fill_nan<P>(d, h);
+    }
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
+
+// corresponding points [lo, hi) of x and y
+template <class P>
+SIMD_INLINE void sm_fast_prep_pairs(const PointSet& x,
+				    const PointSet& y,
+				    R_xlen_t lo,
+				    R_xlen_t hi,
+				    double* out) {
+
+  typedef typename P::V V;
+  const int W = P::W;
+
+  for (R_xlen_t j = lo; j < hi; j += W) {
+    int m = (int)std::min((R_xlen_t)W, hi - j);
+    V d = sm_fast_prep<P>(sm_load_n<P>(x.latr + j, m),
+			  sm_load_n<P>(x.lonr + j, m),
+			  sm_load_n<P>(x.shlat + j, m),
+			  sm_load_n<P>(x.chlat + j, m),
+			  sm_load_n<P>(y.latr + j, m),
+			  sm_load_n<P>(y.lonr + j, m),
+			  sm_load_n<P>(y.shlat + j, m),
+			  sm_load_n<P>(y.chlat + j, m));
+    if (sm_any_nan<P>(d, m)) {
+      V h = sm_haversine_prep<P>(sm_load_n<P>(x.shlat + j, m),
+				 sm_load_n<P>(x.chlat + j, m),
+				 sm_load_n<P>(x.shlon + j, m),
+				 sm_load_n<P>(x.chlon + j, m),
+				 sm_load_n<P>(x.clat + j, m),
+				 sm_load_n<P>(y.shlat + j, m),
+				 sm_load_n<P>(y.chlat + j, m),
+				 sm_load_n<P>(y.shlon + j, m),
+				 sm_load_n<P>(y.chlon + j, m),
+				 sm_load_n<P>(y.clat + j, m));
+      d = sm_fill_nan<P>(d, h);
+    }
+    sm_store_n<P>(out + (j - lo), d, m);
+  }
+}
@@ -6,47 +6,68 @@
 using namespace Rcpp;
 
 // dist_mtom
-Rcpp::NumericMatrix dist_mtom(const Rcpp::NumericVector& xlon, const Rcpp::NumericVector& xlat, const Rcpp::NumericVector& ylon, const Rcpp::NumericVector& ylat, std::string dist_function);
-RcppExport SEXP _distRcpp_dist_mtom(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP) {
+SEXP dist_mtom(SEXP xlon, SEXP xlat, SEXP ylon, SEXP ylat, std::string dist_function, int block_size, int nthreads, std::string output);
+RcppExport SEXP _distRcpp_dist_mtom(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP, SEXP block_sizeSEXP, SEXP nthreadsSEXP, SEXP outputSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type xlon(xlonSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type xlat(xlatSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylon(ylonSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylat(ylatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlon(xlonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlat(xlatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylat(ylatSEXP);
     Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
-    rcpp_result_gen = Rcpp::wrap(dist_mtom(xlon, xlat, ylon, ylat, dist_function));
+    Rcpp::traits::input_parameter< int >::type block_size(block_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_mtom(xlon, xlat, ylon, ylat, dist_function, block_size, nthreads, output));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_self
+Rcpp::NumericVector dist_self(SEXP lon, SEXP lat, std::string dist_function, int block_size, int nthreads);
+RcppExport SEXP _distRcpp_dist_self(SEXP lonSEXP, SEXP latSEXP, SEXP dist_functionSEXP, SEXP block_sizeSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type lon(lonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type lat(latSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    Rcpp::traits::input_parameter< int >::type block_size(block_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_self(lon, lat, dist_function, block_size, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
 // dist_df
-Rcpp::NumericVector dist_df(const Rcpp::NumericVector& xlon, const Rcpp::NumericVector& xlat, const Rcpp::NumericVector& ylon, const Rcpp::NumericVector& ylat, std::string dist_function);
-RcppExport SEXP _distRcpp_dist_df(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP) {
+SEXP dist_df(SEXP xlon, SEXP xlat, SEXP ylon, SEXP ylat, std::string dist_function, int nthreads, std::string output);
+RcppExport SEXP _distRcpp_dist_df(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP, SEXP nthreadsSEXP, SEXP outputSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type xlon(xlonSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type xlat(xlatSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylon(ylonSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylat(ylatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlon(xlonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlat(xlatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylat(ylatSEXP);
     Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
-    rcpp_result_gen = Rcpp::wrap(dist_df(xlon, xlat, ylon, ylat, dist_function));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_df(xlon, xlat, ylon, ylat, dist_function, nthreads, output));
     return rcpp_result_gen;
 END_RCPP
 }
 // dist_1tom
-Rcpp::NumericVector dist_1tom(const double& xlon, const double& xlat, const Rcpp::NumericVector& ylon, const Rcpp::NumericVector& ylat, std::string dist_function);
-RcppExport SEXP _distRcpp_dist_1tom(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP) {
+Rcpp::NumericVector dist_1tom(const double& xlon, const double& xlat, SEXP ylon, SEXP ylat, std::string dist_function, int nthreads);
+RcppExport SEXP _distRcpp_dist_1tom(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP dist_functionSEXP, SEXP nthreadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
     Rcpp::traits::input_parameter< const double& >::type xlon(xlonSEXP);
     Rcpp::traits::input_parameter< const double& >::type xlat(xlatSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylon(ylonSEXP);
-    Rcpp::traits::input_parameter< const Rcpp::NumericVector& >::type ylat(ylatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylat(ylatSEXP);
     Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
-    rcpp_result_gen = Rcpp::wrap(dist_1tom(xlon, xlat, ylon, ylat, dist_function));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_1tom(xlon, xlat, ylon, ylat, dist_function, nthreads));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -66,13 +87,13 @@ BEGIN_RCPP
 END_RCPP
 }
 // popdist_weighted_mean
-Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df, Rcpp::DataFrame y_df, std::string measure_col, std::string x_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string pop_col, std::string dist_function, std::string dist_transform, double decay);
-RcppExport SEXP _distRcpp_popdist_weighted_mean(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP measure_colSEXP, SEXP x_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP pop_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP) {
+Rcpp::DataFrame popdist_weighted_mean(SEXP x_df, SEXP y_df, std::string measure_col, std::string x_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string pop_col, std::string dist_function, std::string dist_transform, double decay, int nthreads, double tolerance, double max_dist, int k_neighbors);
+RcppExport SEXP _distRcpp_popdist_weighted_mean(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP measure_colSEXP, SEXP x_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP pop_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP, SEXP nthreadsSEXP, SEXP toleranceSEXP, SEXP max_distSEXP, SEXP k_neighborsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type x_df(x_dfSEXP);
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
     Rcpp::traits::input_parameter< std::string >::type measure_col(measure_colSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
@@ -83,18 +104,22 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
     Rcpp::traits::input_parameter< std::string >::type dist_transform(dist_transformSEXP);
     Rcpp::traits::input_parameter< double >::type decay(decaySEXP);
-    rcpp_result_gen = Rcpp::wrap(popdist_weighted_mean(x_df, y_df, measure_col, x_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, pop_col, dist_function, dist_transform, decay));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    Rcpp::traits::input_parameter< double >::type max_dist(max_distSEXP);
+    Rcpp::traits::input_parameter< int >::type k_neighbors(k_neighborsSEXP);
+    rcpp_result_gen = Rcpp::wrap(popdist_weighted_mean(x_df, y_df, measure_col, x_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, pop_col, dist_function, dist_transform, decay, nthreads, tolerance, max_dist, k_neighbors));
     return rcpp_result_gen;
 END_RCPP
 }
 // dist_weighted_mean
-Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df, Rcpp::DataFrame y_df, std::string measure_col, std::string x_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function, std::string dist_transform, double decay);
-RcppExport SEXP _distRcpp_dist_weighted_mean(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP measure_colSEXP, SEXP x_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP) {
+Rcpp::DataFrame dist_weighted_mean(SEXP x_df, SEXP y_df, std::string measure_col, std::string x_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function, std::string dist_transform, double decay, int nthreads, double tolerance, double max_dist, int k_neighbors);
+RcppExport SEXP _distRcpp_dist_weighted_mean(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP measure_colSEXP, SEXP x_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP, SEXP nthreadsSEXP, SEXP toleranceSEXP, SEXP max_distSEXP, SEXP k_neighborsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type x_df(x_dfSEXP);
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
     Rcpp::traits::input_parameter< std::string >::type measure_col(measure_colSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
@@ -104,18 +129,22 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
     Rcpp::traits::input_parameter< std::string >::type dist_transform(dist_transformSEXP);
     Rcpp::traits::input_parameter< double >::type decay(decaySEXP);
-    rcpp_result_gen = Rcpp::wrap(dist_weighted_mean(x_df, y_df, measure_col, x_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function, dist_transform, decay));
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    Rcpp::traits::input_parameter< double >::type max_dist(max_distSEXP);
+    Rcpp::traits::input_parameter< int >::type k_neighbors(k_neighborsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_weighted_mean(x_df, y_df, measure_col, x_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function, dist_transform, decay, nthreads, tolerance, max_dist, k_neighbors));
     return rcpp_result_gen;
 END_RCPP
 }
 // dist_min
-Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df, Rcpp::DataFrame y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
+Rcpp::DataFrame dist_min(SEXP x_df, SEXP y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
 RcppExport SEXP _distRcpp_dist_min(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type x_df(x_dfSEXP);
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type y_id(y_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
@@ -128,13 +157,13 @@ BEGIN_RCPP
 END_RCPP
 }
 // dist_max
-Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df, Rcpp::DataFrame y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
+Rcpp::DataFrame dist_max(SEXP x_df, SEXP y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
 RcppExport SEXP _distRcpp_dist_max(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type x_df(x_dfSEXP);
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type y_id(y_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
@@ -146,14 +175,92 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// dist_knn
+Rcpp::DataFrame dist_knn(SEXP x_df, SEXP y_df, int k, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
+RcppExport SEXP _distRcpp_dist_knn(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP kSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< int >::type k(kSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_id(y_idSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lat_col(x_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lon_col(y_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lat_col(y_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_knn(x_df, y_df, k, x_id, y_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_within
+Rcpp::DataFrame dist_within(SEXP x_df, SEXP y_df, double radius, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function);
+RcppExport SEXP _distRcpp_dist_within(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP radiusSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< double >::type radius(radiusSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_id(y_idSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lat_col(x_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lon_col(y_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lat_col(y_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_within(x_df, y_df, radius, x_id, y_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_mtom_sparse
+Rcpp::List dist_mtom_sparse(SEXP xlon, SEXP xlat, SEXP ylon, SEXP ylat, double max_dist, std::string dist_function, int nthreads);
+RcppExport SEXP _distRcpp_dist_mtom_sparse(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP max_distSEXP, SEXP dist_functionSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type xlon(xlonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlat(xlatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylat(ylatSEXP);
+    Rcpp::traits::input_parameter< double >::type max_dist(max_distSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_mtom_sparse(xlon, xlat, ylon, ylat, max_dist, dist_function, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_within_sum
+Rcpp::DataFrame dist_within_sum(SEXP x_df, SEXP y_df, Rcpp::NumericVector radius, std::string measure_col, std::string x_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function, int nthreads);
+RcppExport SEXP _distRcpp_dist_within_sum(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP radiusSEXP, SEXP measure_colSEXP, SEXP x_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< Rcpp::NumericVector >::type radius(radiusSEXP);
+    Rcpp::traits::input_parameter< std::string >::type measure_col(measure_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type x_lat_col(x_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lon_col(y_lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type y_lat_col(y_lat_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_within_sum(x_df, y_df, radius, measure_col, x_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function, nthreads));
+    return rcpp_result_gen;
+END_RCPP
+}
 // dist_sum_inv
-Rcpp::DataFrame dist_sum_inv(Rcpp::DataFrame x_df, Rcpp::DataFrame y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function, std::string dist_transform, double decay, double scale_units);
-RcppExport SEXP _distRcpp_dist_sum_inv(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP, SEXP scale_unitsSEXP) {
+Rcpp::DataFrame dist_sum_inv(SEXP x_df, SEXP y_df, std::string x_id, std::string y_id, std::string x_lon_col, std::string x_lat_col, std::string y_lon_col, std::string y_lat_col, std::string dist_function, std::string dist_transform, double decay, double scale_units, double tolerance);
+RcppExport SEXP _distRcpp_dist_sum_inv(SEXP x_dfSEXP, SEXP y_dfSEXP, SEXP x_idSEXP, SEXP y_idSEXP, SEXP x_lon_colSEXP, SEXP x_lat_colSEXP, SEXP y_lon_colSEXP, SEXP y_lat_colSEXP, SEXP dist_functionSEXP, SEXP dist_transformSEXP, SEXP decaySEXP, SEXP scale_unitsSEXP, SEXP toleranceSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type x_df(x_dfSEXP);
-    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type x_df(x_dfSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_id(x_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type y_id(y_idSEXP);
     Rcpp::traits::input_parameter< std::string >::type x_lon_col(x_lon_colSEXP);
@@ -164,7 +271,115 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< std::string >::type dist_transform(dist_transformSEXP);
     Rcpp::traits::input_parameter< double >::type decay(decaySEXP);
     Rcpp::traits::input_parameter< double >::type scale_units(scale_unitsSEXP);
-    rcpp_result_gen = Rcpp::wrap(dist_sum_inv(x_df, y_df, x_id, y_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function, dist_transform, decay, scale_units));
+    Rcpp::traits::input_parameter< double >::type tolerance(toleranceSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_sum_inv(x_df, y_df, x_id, y_id, x_lon_col, x_lat_col, y_lon_col, y_lat_col, dist_function, dist_transform, decay, scale_units, tolerance));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geo_index_build
+SEXP geo_index_build(Rcpp::DataFrame y_df, std::string lon_col, std::string lat_col, bool projected);
+RcppExport SEXP _distRcpp_geo_index_build(SEXP y_dfSEXP, SEXP lon_colSEXP, SEXP lat_colSEXP, SEXP projectedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::DataFrame >::type y_df(y_dfSEXP);
+    Rcpp::traits::input_parameter< std::string >::type lon_col(lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type lat_col(lat_colSEXP);
+    Rcpp::traits::input_parameter< bool >::type projected(projectedSEXP);
+    rcpp_result_gen = Rcpp::wrap(geo_index_build(y_df, lon_col, lat_col, projected));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geo_index_info
+Rcpp::List geo_index_info(SEXP index);
+RcppExport SEXP _distRcpp_geo_index_info(SEXP indexSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type index(indexSEXP);
+    rcpp_result_gen = Rcpp::wrap(geo_index_info(index));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geo_index_save
+SEXP geo_index_save(SEXP index, std::string path, std::string id_col);
+RcppExport SEXP _distRcpp_geo_index_save(SEXP indexSEXP, SEXP pathSEXP, SEXP id_colSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type index(indexSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type id_col(id_colSEXP);
+    rcpp_result_gen = Rcpp::wrap(geo_index_save(index, path, id_col));
+    return rcpp_result_gen;
+END_RCPP
+}
+// geo_index_load
+SEXP geo_index_load(std::string path, SEXP y_df);
+RcppExport SEXP _distRcpp_geo_index_load(SEXP pathSEXP, SEXP y_dfSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type y_df(y_dfSEXP);
+    rcpp_result_gen = Rcpp::wrap(geo_index_load(path, y_df));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_mtom_file
+SEXP dist_mtom_file(SEXP xlon, SEXP xlat, SEXP ylon, SEXP ylat, std::string path, std::string dist_function, int block_size, int nthreads, std::string output);
+RcppExport SEXP _distRcpp_dist_mtom_file(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP, SEXP pathSEXP, SEXP dist_functionSEXP, SEXP block_sizeSEXP, SEXP nthreadsSEXP, SEXP outputSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type xlon(xlonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type xlat(xlatSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type ylat(ylatSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type dist_function(dist_functionSEXP);
+    Rcpp::traits::input_parameter< int >::type block_size(block_sizeSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_mtom_file(xlon, xlat, ylon, ylat, path, dist_function, block_size, nthreads, output));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_mtom_read
+SEXP dist_mtom_read(std::string path, SEXP rows, SEXP cols);
+RcppExport SEXP _distRcpp_dist_mtom_read(SEXP pathSEXP, SEXP rowsSEXP, SEXP colsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type rows(rowsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type cols(colsSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_mtom_read(path, rows, cols));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dist_mtom_info
+Rcpp::List dist_mtom_info(std::string path);
+RcppExport SEXP _distRcpp_dist_mtom_info(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_mtom_info(path));
+    return rcpp_result_gen;
+END_RCPP
+}
+// prepare_points
+SEXP prepare_points(SEXP x, SEXP lat, std::string lon_col, std::string lat_col);
+RcppExport SEXP _distRcpp_prepare_points(SEXP xSEXP, SEXP latSEXP, SEXP lon_colSEXP, SEXP lat_colSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type lat(latSEXP);
+    Rcpp::traits::input_parameter< std::string >::type lon_col(lon_colSEXP);
+    Rcpp::traits::input_parameter< std::string >::type lat_col(lat_colSEXP);
+    rcpp_result_gen = Rcpp::wrap(prepare_points(x, lat, lon_col, lat_col));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -207,6 +422,20 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// dist_karney
+double dist_karney(const double& xlon, const double& xlat, const double& ylon, const double& ylat);
+RcppExport SEXP _distRcpp_dist_karney(SEXP xlonSEXP, SEXP xlatSEXP, SEXP ylonSEXP, SEXP ylatSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const double& >::type xlon(xlonSEXP);
+    Rcpp::traits::input_parameter< const double& >::type xlat(xlatSEXP);
+    Rcpp::traits::input_parameter< const double& >::type ylon(ylonSEXP);
+    Rcpp::traits::input_parameter< const double& >::type ylat(ylatSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_karney(xlon, xlat, ylon, ylat));
+    return rcpp_result_gen;
+END_RCPP
+}
 // inverse_value
 Rcpp::NumericVector inverse_value(const Rcpp::NumericVector& d, double exp, std::string transform);
 RcppExport SEXP _distRcpp_inverse_value(SEXP dSEXP, SEXP expSEXP, SEXP transformSEXP) {
@@ -220,21 +449,58 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// dist_as_double
+Rcpp::NumericVector dist_as_double(SEXP x);
+RcppExport SEXP _distRcpp_dist_as_double(SEXP xSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type x(xSEXP);
+    rcpp_result_gen = Rcpp::wrap(dist_as_double(x));
+    return rcpp_result_gen;
+END_RCPP
+}
+// simd_level
+std::string simd_level();
+RcppExport SEXP _distRcpp_simd_level() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(simd_level());
+    return rcpp_result_gen;
+END_RCPP
+}
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_distRcpp_dist_mtom", (DL_FUNC) &_distRcpp_dist_mtom, 5},
-    {"_distRcpp_dist_df", (DL_FUNC) &_distRcpp_dist_df, 5},
-    {"_distRcpp_dist_1tom", (DL_FUNC) &_distRcpp_dist_1tom, 5},
+    {"_distRcpp_dist_mtom", (DL_FUNC) &_distRcpp_dist_mtom, 8},
+    {"_distRcpp_dist_self", (DL_FUNC) &_distRcpp_dist_self, 5},
+    {"_distRcpp_dist_df", (DL_FUNC) &_distRcpp_dist_df, 7},
+    {"_distRcpp_dist_1tom", (DL_FUNC) &_distRcpp_dist_1tom, 6},
     {"_distRcpp_dist_1to1", (DL_FUNC) &_distRcpp_dist_1to1, 5},
-    {"_distRcpp_popdist_weighted_mean", (DL_FUNC) &_distRcpp_popdist_weighted_mean, 12},
-    {"_distRcpp_dist_weighted_mean", (DL_FUNC) &_distRcpp_dist_weighted_mean, 11},
+    {"_distRcpp_popdist_weighted_mean", (DL_FUNC) &_distRcpp_popdist_weighted_mean, 16},
+    {"_distRcpp_dist_weighted_mean", (DL_FUNC) &_distRcpp_dist_weighted_mean, 15},
     {"_distRcpp_dist_min", (DL_FUNC) &_distRcpp_dist_min, 9},
     {"_distRcpp_dist_max", (DL_FUNC) &_distRcpp_dist_max, 9},
-    {"_distRcpp_dist_sum_inv", (DL_FUNC) &_distRcpp_dist_sum_inv, 12},
+    {"_distRcpp_dist_knn", (DL_FUNC) &_distRcpp_dist_knn, 10},
+    {"_distRcpp_dist_within", (DL_FUNC) &_distRcpp_dist_within, 10},
+    {"_distRcpp_dist_mtom_sparse", (DL_FUNC) &_distRcpp_dist_mtom_sparse, 7},
+    {"_distRcpp_dist_within_sum", (DL_FUNC) &_distRcpp_dist_within_sum, 11},
+    {"_distRcpp_dist_sum_inv", (DL_FUNC) &_distRcpp_dist_sum_inv, 13},
+    {"_distRcpp_geo_index_build", (DL_FUNC) &_distRcpp_geo_index_build, 4},
+    {"_distRcpp_geo_index_info", (DL_FUNC) &_distRcpp_geo_index_info, 1},
+    {"_distRcpp_geo_index_save", (DL_FUNC) &_distRcpp_geo_index_save, 3},
+    {"_distRcpp_geo_index_load", (DL_FUNC) &_distRcpp_geo_index_load, 2},
+    {"_distRcpp_dist_mtom_file", (DL_FUNC) &_distRcpp_dist_mtom_file, 9},
+    {"_distRcpp_dist_mtom_read", (DL_FUNC) &_distRcpp_dist_mtom_read, 3},
+    {"_distRcpp_dist_mtom_info", (DL_FUNC) &_distRcpp_dist_mtom_info, 1},
+    {"_distRcpp_prepare_points", (DL_FUNC) &_distRcpp_prepare_points, 4},
     {"_distRcpp_deg_to_rad", (DL_FUNC) &_distRcpp_deg_to_rad, 1},
     {"_distRcpp_dist_haversine", (DL_FUNC) &_distRcpp_dist_haversine, 4},
     {"_distRcpp_dist_vincenty", (DL_FUNC) &_distRcpp_dist_vincenty, 4},
+    {"_distRcpp_dist_karney", (DL_FUNC) &_distRcpp_dist_karney, 4},
     {"_distRcpp_inverse_value", (DL_FUNC) &_distRcpp_inverse_value, 3},
+    {"_distRcpp_dist_as_double", (DL_FUNC) &_distRcpp_dist_as_double, 1},
+    {"_distRcpp_simd_level", (DL_FUNC) &_distRcpp_simd_level, 0},
     {NULL, NULL, 0}
 };
 
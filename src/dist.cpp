@@ -1,77 +1,274 @@
 // dist.cpp
+#include <climits>
+#include <geotree.h>
+#include <parallel.h>
+#include <points.h>
+#include <simd.h>
 #include <shared.h>
+#include <kernels.h>
 #include <Rcpp.h>
 
 //' Compute distance between each coordinate pair (many to many)
 //' and return matrix.
 //'
-//' @param xlon Vector of longitudes for starting coordinate pairs
-//' @param xlat Vector of latitudes for starting coordinate pairs
-//' @param ylon Vector of longitudes for ending coordinate pairs
-//' @param ylat Vector of latitudes for ending coordinate pairs
-//' @param dist_function String name of distance function: Haversine, Vincenty
+//' The matrix is filled in square tiles of \code{block_size} starting and
+//' ending points. Within a tile, each ending point (matrix column) is written
+//' as one contiguous run of rows, which keeps the column-major output and the
+//' current block of starting coordinates in cache for large matrices. Columns
+//' of tiles are shared out across \code{nthreads} threads.
+//'
+//' @param xlon Vector of longitudes for starting coordinate pairs, or
+//' prepared point set (see \code{prepare_points()})
+//' @param xlat Vector of latitudes for starting coordinate pairs; ignored
+//' (use \code{NULL}) when \code{xlon} is a prepared point set
+//' @param ylon Vector of longitudes for ending coordinate pairs, or
+//' prepared point set
+//' @param ylat Vector of latitudes for ending coordinate pairs; ignored
+//' (use \code{NULL}) when \code{ylon} is a prepared point set
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param block_size Integer number of points per tile edge; 0 (default)
+//' picks a tile that fits in a typical L2 cache
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @param output String type of returned distances: "double" (default);
+//' "float", single precision, good to about 7 significant digits (within
+//' 1.2 m at 20,000 km); or "meters" or "decimeters", rounded to whole
+//' units. All but "double" are held in an integer vector, half the memory;
+//' convert with \code{dist_as_double()}
 //' @return Matrix of distances between each coordinate pair in meters
 //' @export
 // [[Rcpp::export]]
-Rcpp::NumericMatrix dist_mtom(const Rcpp::NumericVector& xlon,
-			      const Rcpp::NumericVector& xlat,
-			      const Rcpp::NumericVector& ylon,
-			      const Rcpp::NumericVector& ylat,
-			      std::string dist_function="Haversine") {
+SEXP dist_mtom(SEXP xlon,
+	       SEXP xlat,
+	       SEXP ylon,
+	       SEXP ylat,
+	       std::string dist_function="Haversine",
+	       int block_size = 0,
+	       int nthreads = 0,
+	       std::string output = "double") {
+
+  // select function and value type
+  int kind = dist_kind_of(dist_function);
+  int otype = out_kind_of(output);
+
+  // each point is paired many times, so prepare both sets once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = points_of(xlon, xlat, xtmp);
+  const PointSet& yp = points_of(ylon, ylat, ytmp);
+
+  int n = xp.n;
+  int k = yp.n;
+  int bs = tile_size(block_size);
+  int nt = resolve_threads(nthreads);
+
+  // raw buffer for worker threads
+  void* out;
+  Rcpp::RObject dist = alloc_dist(otype, (R_xlen_t)n * k, &out);
+  dist.attr("dim") = Rcpp::IntegerVector::create(n, k);
+
+  // each chunk is one column of tiles; walk its tiles so that each
+  // column segment is written contiguously
+  parallel_for(k, bs, nt, [&](R_xlen_t jb, R_xlen_t jend) {
+
+      // compact types are converted from a segment of doubles
+      std::vector<double> seg(otype == OUT_DOUBLE ? 0 : bs);
+
+      for(int ib = 0; ib < n; ib += bs) {
+
+	int iend = std::min(ib + bs, n);
+
+	for(R_xlen_t j = jb; j < jend; j++) {
+
+	  // batch kernel over the column segment
+	  if (otype == OUT_DOUBLE) {
+	    double* col = static_cast<double*>(out) + j * n;
+	    batch_prep_1tom(kind, yp, j, xp, ib, iend, col + ib);
+	  } else {
+	    batch_prep_1tom(kind, yp, j, xp, ib, iend, seg.data());
+	    store_dist(otype, seg.data(), iend - ib, out, j * n + ib);
+	  }
+
+	}
+      }
+    });
+  
+  return dist;
+
+}
+
+//' Compute distance between each pair of one set of coordinates and
+//' return a dist object.
+//'
+//' Distances are symmetric and zero on the diagonal, so only the pairs
+//' below the diagonal are computed and stored, packed by column as in
+//' \code{stats::dist()}: half the time and memory of
+//' \code{dist_mtom(lon, lat, lon, lat)}, whose lower triangle it matches.
+//' The result can be passed to \code{hclust()} or \code{cmdscale()}, or
+//' expanded with \code{as.matrix()}. Columns are computed in tiles of
+//' \code{block_size} points as in \code{dist_mtom()} and shared out across
+//' \code{nthreads} threads.
+//'
+//' @param lon Vector of longitudes, or prepared point set (see
+//' \code{prepare_points()})
+//' @param lat Vector of latitudes; ignored (use \code{NULL}) when
+//' \code{lon} is a prepared point set
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param block_size Integer number of points per tile edge; 0 (default)
+//' picks a tile that fits in a typical L2 cache
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @return Object of class \code{dist} with distances in meters
+//' @export
+// [[Rcpp::export]]
+Rcpp::NumericVector dist_self(SEXP lon,
+			      SEXP lat = R_NilValue,
+			      std::string dist_function="Haversine",
+			      int block_size = 0,
+			      int nthreads = 0) {
 
   // select function
-  Rcpp::XPtr<funcPtr> xpfun = choose_func(dist_function);
-  funcPtr fun = *xpfun;
+  int kind = dist_kind_of(dist_function);
 
-  int n = xlon.size();
-  int k = ylon.size();
+  PointSet ptmp;
+  const PointSet& p = points_of(lon, lat, ptmp);
 
-  Rcpp::NumericMatrix dist(n,k);
+  R_xlen_t n = p.n;
+  int bs = tile_size(block_size);
+  int nt = resolve_threads(nthreads);
+
+  Rcpp::NumericVector dist(n * (n - 1) / 2);
+
+  // raw buffer for worker threads
+  double* out = dist.begin();
+
+  // column j holds rows (j, n), from n j - j (j + 1) / 2; as in
+  // dist_mtom(), each chunk is one column of tiles, and below the
+  // diagonal each column segment is written contiguously
+  parallel_for(n, bs, nt, [&](R_xlen_t jb, R_xlen_t jend) {
+
+      for(R_xlen_t ib = jb + 1; ib < n; ib += bs) {
+
+	R_xlen_t iend = std::min(ib + bs, n);
+
+	for(R_xlen_t j = jb; j < jend && j + 1 < iend; j++) {
+
+	  R_xlen_t lo = std::max(ib, j + 1);
+	  double* col = out + (n * j - j * (j + 1) / 2) - (j + 1);
+
+	  // batch kernel over the column segment
+	  batch_prep_1tom(kind, p, j, p, lo, iend, col + lo);
+
+	}
+      }
+    });
+
+  dist.attr("Size") = (int) n;
+  dist.attr("Diag") = false;
+  dist.attr("Upper") = false;
+  dist.attr("method") = dist_function;
+  dist.attr("class") = "dist";
 
-  for(int i = 0; i < n; i++) {
-    for(int j = 0; j < k; j++) {
-      
-      // compute distance and store
-      dist(i,j) = fun(xlon[i], xlat[i], ylon[j], ylat[j]);
-      
-    }
-  }
-  
   return dist;
 
 }
+
 //' Compute distance between corresponding coordinate pairs in data frame.
 //'
 //' Compute distance between corresponding coordinate pairs and return vector.
 //' For use when creating a new data frame or tbl_df column.
 //'
-//' @param xlon Vector of longitudes for starting coordinate pairs
-//' @param xlat Vector of latitudes for starting coordinate pairs
-//' @param ylon Vector of longitudes for ending coordinate pairs
-//' @param ylat Vector of latitudes for ending coordinate pairs
-//' @param dist_function String name of distance function: Haversine, Vincenty
+//' @param xlon Vector of longitudes for starting coordinate pairs, or
+//' prepared point set (see \code{prepare_points()})
+//' @param xlat Vector of latitudes for starting coordinate pairs; ignored
+//' (use \code{NULL}) when \code{xlon} is a prepared point set
+//' @param ylon Vector of longitudes for ending coordinate pairs, or
+//' prepared point set
+//' @param ylat Vector of latitudes for ending coordinate pairs; ignored
+//' (use \code{NULL}) when \code{ylon} is a prepared point set
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @param output String type of returned distances: "double" (default);
+//' "float", single precision, good to about 7 significant digits (within
+//' 1.2 m at 20,000 km); or "meters" or "decimeters", rounded to whole
+//' units. All but "double" are held in an integer vector, half the memory;
+//' convert with \code{dist_as_double()}
 //' @return Vector of distances between each coordinate pair in meters
 //' @export
 // [[Rcpp::export]]
-Rcpp::NumericVector dist_df(const Rcpp::NumericVector& xlon,
-			    const Rcpp::NumericVector& xlat,
-			    const Rcpp::NumericVector& ylon,
-			    const Rcpp::NumericVector& ylat,
-			    std::string dist_function="Haversine") {
+SEXP dist_df(SEXP xlon,
+	     SEXP xlat,
+	     SEXP ylon,
+	     SEXP ylat,
+	     std::string dist_function="Haversine",
+	     int nthreads = 0,
+	     std::string output = "double") {
+
+  // select function and value type
+  int kind = dist_kind_of(dist_function);
+  int otype = out_kind_of(output);
+
+  int nt = resolve_threads(nthreads);
+
+  // each pair is used once, so raw coordinates are not worth preparing
+  // unless one side already is
+  if (as_points(xlon) != NULL || as_points(ylon) != NULL) {
+
+    PointSet xtmp, ytmp;
+    const PointSet& xp = points_of(xlon, xlat, xtmp);
+    const PointSet& yp = points_of(ylon, ylat, ytmp);
+
+    int k = yp.n;
+    void* out;
+    Rcpp::RObject dist = alloc_dist(otype, k, &out);
+
+    parallel_for(k, PAIR_GRAIN, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+	// batch kernel, through doubles for compact types
+	if (otype == OUT_DOUBLE) {
+	  batch_prep_pairs(kind, xp, yp, lo, hi, static_cast<double*>(out) + lo);
+	} else {
+	  std::vector<double> seg(hi - lo);
+	  batch_prep_pairs(kind, xp, yp, lo, hi, seg.data());
+	  store_dist(otype, seg.data(), hi - lo, out, lo);
+	}
+      });
+
+    return dist;
 
-  // select function
-  Rcpp::XPtr<funcPtr> xpfun = choose_func(dist_function);
-  funcPtr fun = *xpfun;
+  }
 
-  int k = ylon.size();
-  Rcpp::NumericVector dist(k);
+  Rcpp::NumericVector xlon_v(xlon), xlat_v(xlat), ylon_v(ylon), ylat_v(ylat);
 
-  for(int i = 0; i < k; i++) {
+  int k = ylon_v.size();
 
-    // compute distance and store
-    dist[i] = fun(xlon[i], xlat[i], ylon[i], ylat[i]);
+  // raw buffers for worker threads
+  const double* xlo = xlon_v.begin();
+  const double* xla = xlat_v.begin();
+  const double* ylo = ylon_v.begin();
+  const double* yla = ylat_v.begin();
+  void* out;
+  Rcpp::RObject dist = alloc_dist(otype, k, &out);
 
-  }
+  parallel_for(k, PAIR_GRAIN, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+      // batch kernel, through doubles for compact types
+      if (otype == OUT_DOUBLE) {
+	batch_pairs(kind, xlo + lo, xla + lo, ylo + lo, yla + lo,
+		    hi - lo, static_cast<double*>(out) + lo);
+      } else {
+	std::vector<double> seg(hi - lo);
+	batch_pairs(kind, xlo + lo, xla + lo, ylo + lo, yla + lo,
+		    hi - lo, seg.data());
+	store_dist(otype, seg.data(), hi - lo, out, lo);
+      }
+    });
 
   return dist;
 
@@ -84,32 +281,70 @@ Rcpp::NumericVector dist_df(const Rcpp::NumericVector& xlon,
 //'
 //' @param xlon Longitude for starting coordinate pair
 //' @param xlat Latitude for starting coordinate pair
-//' @param ylon Vector of longitudes for ending coordinate pairs
-//' @param ylat Vector of latitudes for ending coordinate pairs
-//' @param dist_function String name of distance function: Haversine, Vincenty
+//' @param ylon Vector of longitudes for ending coordinate pairs, or
+//' prepared point set (see \code{prepare_points()})
+//' @param ylat Vector of latitudes for ending coordinate pairs; ignored
+//' (use \code{NULL}) when \code{ylon} is a prepared point set
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
 //' @return Vector of distances in meters
 //' @export
 // [[Rcpp::export]]
 Rcpp::NumericVector dist_1tom(const double& xlon,
 			      const double& xlat,
-			      const Rcpp::NumericVector& ylon,
-			      const Rcpp::NumericVector& ylat,
-			      std::string dist_function="Haversine") {
+			      SEXP ylon,
+			      SEXP ylat = R_NilValue,
+			      std::string dist_function="Haversine",
+			      int nthreads = 0) {
 
   // select function
-  Rcpp::XPtr<funcPtr> xpfun = choose_func(dist_function);
-  funcPtr fun = *xpfun;
+  int kind = dist_kind_of(dist_function);
 
-  int k = ylon.size();
-  Rcpp::NumericVector dist(k);
+  int nt = resolve_threads(nthreads);
+  const double x1 = xlon;
+  const double x2 = xlat;
+
+  // prepared ending points: prepare the starting point to match
+  const PointSet* yp = as_points(ylon);
+
+  if (yp != NULL) {
+
+    PointSet xp;
+    prepare_into(xp, &x1, &x2, 1);
 
-  for(int i = 0; i < k; i++) {
+    int k = yp->n;
+    Rcpp::NumericVector dist(k);
+    double* out = dist.begin();
 
-    // compute distance and store
-    dist[i] = fun(xlon, xlat, ylon[i], ylat[i]);
+    parallel_for(k, PAIR_GRAIN, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+	// batch kernel
+	batch_prep_1tom(kind, xp, 0, *yp, lo, hi, out + lo);
+      });
+
+    return dist;
 
   }
 
+  Rcpp::NumericVector ylon_v(ylon), ylat_v(ylat);
+
+  int k = ylon_v.size();
+  Rcpp::NumericVector dist(k);
+
+  // raw buffers for worker threads
+  const double* ylo = ylon_v.begin();
+  const double* yla = ylat_v.begin();
+  double* out = dist.begin();
+
+  parallel_for(k, PAIR_GRAIN, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+      // batch kernel
+      batch_1tom(kind, x1, x2, ylo + lo, yla + lo, hi - lo, out + lo);
+    });
+
   return dist;
 
 }
@@ -118,12 +353,26 @@ Rcpp::NumericVector dist_1tom(const double& xlon,
 //'
 //' Compute distance between two points (one to one) and return single value.
 //'
+//' Euclidean and Manhattan distances are for projected coordinates (state
+//' plane, Albers, UTM, ...): x takes the place of longitude and y of
+//' latitude, and distances are in their units. So it is with every
+//' function that takes \code{dist_function}.
+//'
+//' "Fast" is the equirectangular approximation, about twice as fast as
+//' Haversine, where it is sure to be within 0.5 meters of the Haversine
+//' distance (it is never shorter): pairs less than 0.1 radians
+//' (5.7 degrees) apart in latitude and in longitude whose bound on the
+//' error allows it, which takes in pairs up to 50 km apart below 50
+//' degrees latitude. Other pairs, including those across the
+//' antimeridian, get the Haversine distance.
+//'
 //' @param xlon Longitude for starting coordinate pair
 //' @param xlat Latitude for starting coordinate pair
 //' @param ylon Longitude for ending coordinate pair
 //' @param ylat Latitude for ending coordinate pair
-//' @param dist_function String name of distance function: Haversine, Vincenty
-//' @return Distance in meters
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @return Distance in meters, or in the units of projected coordinates
 //' @export
 // [[Rcpp::export]]
 double dist_1to1(const double& xlon,
@@ -133,11 +382,755 @@ double dist_1to1(const double& xlon,
 		 std::string dist_function="Haversine") {
 
   // select function
-  Rcpp::XPtr<funcPtr> xpfun = choose_func(dist_function);
-  funcPtr fun = *xpfun;
+  int kind = dist_kind_of(dist_function);
 
   // compute and return
-  return fun(xlon, xlat, ylon, ylat);
+  double dist = 0;
+  KERNEL_DISPATCH(kind, K, dist = K::pair(xlon, xlat, ylon, ylat));
+  return dist;
+
+}
+
+// whether points [lo, hi) of p all have finite coordinates
+static bool finite_points(const PointSet& p, R_xlen_t lo, R_xlen_t hi) {
+  for (R_xlen_t j = lo; j < hi; j++) {
+    if (!std::isfinite(p.lon[j]) || !std::isfinite(p.lat[j]))
+      return false;
+  }
+  return true;
+}
+
+// ids at rows of column col as strings, as CharacterVector(col) would give
+// them but converting only those rows; negative rows give NA
+static Rcpp::CharacterVector ids_at(SEXP col,
+				    const std::vector<R_xlen_t>& rows) {
+
+  R_xlen_t m = rows.size();
+  int type = TYPEOF(col);
+
+  if (type != REALSXP && type != INTSXP) {
+    Rcpp::CharacterVector all(col);
+    Rcpp::CharacterVector out(m);
+    for (R_xlen_t r = 0; r < m; r++) {
+      if (rows[r] < 0)
+	out[r] = NA_STRING;
+      else
+	out[r] = all[rows[r]];
+    }
+    return out;
+  }
+
+  Rcpp::Shield<SEXP> sub(Rf_allocVector(type, m));
+
+  for (R_xlen_t r = 0; r < m; r++) {
+    if (type == REALSXP)
+      REAL(sub)[r] = rows[r] < 0 ? NA_REAL : REAL(col)[rows[r]];
+    else
+      INTEGER(sub)[r] = rows[r] < 0 ? NA_INTEGER : INTEGER(col)[rows[r]];
+  }
+
+  // keep class and levels, so factors convert by label
+  Rf_copyMostAttrib(col, sub);
+
+  return Rcpp::CharacterVector((SEXP)sub);
+
+}
+
+// compute inverse-distance-weighted mean of measure for rows [lo, hi)
+// of x; pop may be NULL. Distances come FUSE_BLOCK at a time and each
+// block is reduced to the weight sum and weighted measure sum in one
+// pass, so no row-length buffer is needed
+template <class W>
+static void idw_rows(R_xlen_t lo, R_xlen_t hi, int kind,
+		     const PointSet& x, const PointSet& y,
+		     const double* meas, const double* pop,
+		     const W& weight, double* out) {
+
+  R_xlen_t k = y.n;
+  double d[FUSE_BLOCK];
+
+  for (R_xlen_t i = lo; i < hi; i++) {
+
+    double w_sum = 0;
+    double sum = 0;
+
+    for (R_xlen_t jb = 0; jb < k; jb += FUSE_BLOCK) {
+
+      R_xlen_t jend = std::min(jb + FUSE_BLOCK, k);
+
+      // distances
+      batch_prep_1tom(kind, x, i, y, jb, jend, d);
+
+      // inverse distance weights, population adjusted if given, and
+      // the weight denominator and weighted measure sums
+      if (pop != NULL) {
+	for (R_xlen_t j = jb; j < jend; j++) {
+	  double w = weight(d[j - jb]) * pop[j];
+	  w_sum += w;
+	  sum += w * meas[j];
+	}
+      } else {
+	for (R_xlen_t j = jb; j < jend; j++) {
+	  double w = weight(d[j - jb]);
+	  w_sum += w;
+	  sum += w * meas[j];
+	}
+      }
+    }
+
+    out[i] = sum / w_sum;
+
+  }
+}
+
+// Haversine terms h of point i of x to every point of y, into h, with
+// their least and greatest in *lo and *hi (NaN if any is missing).
+// Distances are 2 a asin(sqrt(h)), so h orders pairs as their distances
+// do, for a few multiplications each.
+static void haversine_terms(const PointSet& x, R_xlen_t i,
+			    const PointSet& y, double* h,
+			    double* lo, double* hi) {
+
+  double sl = x.shlat[i], cl = x.chlat[i];
+  double so = x.shlon[i], co = x.chlon[i];
+  double c = x.clat[i];
+
+  const double* ysl = y.shlat;
+  const double* ycl = y.chlat;
+  const double* yso = y.shlon;
+  const double* yco = y.chlon;
+  const double* yc = y.clat;
+
+  // NaN carries through the sum, not through min and max
+  double mn = std::numeric_limits<double>::infinity(), mx = -mn, sum = 0;
+
+  for (R_xlen_t j = 0; j < y.n; j++) {
+    double d1 = ysl[j] * cl - ycl[j] * sl;
+    double d2 = yso[j] * co - yco[j] * so;
+    double v = d1 * d1 + c * yc[j] * d2 * d2;
+    h[j] = v;
+    sum += v;
+    mn = std::min(mn, v);
+    mx = std::max(mx, v);
+  }
+
+  *lo = std::isnan(sum) ? sum : mn;
+  *hi = std::isnan(sum) ? sum : mx;
+
+}
+
+// Point of y nearest to point i of x (farthest if most), with its
+// distance in *dist; ties go to the lowest index, and a missing distance
+// gives NA and -1, as min() and which_min() would. Points are compared
+// on their haversine terms, h in buffer (y.n values), and full distances
+// are computed only for those that could win: within rounding of the
+// best h for Haversine, within FAST_MAX_ERROR of it for Fast, and on
+// the ellipsoid, within the factors of the Haversine distance that
+// geodesics lie between (see geo_node_range()).
+// The Andoyer-Lambert and Thomas approximations leave that band near
+// antipodal points, and planar coordinates have no haversine terms, so
+// these get every distance.
+static R_xlen_t extreme_point(int kind, const PointSet& x, R_xlen_t i,
+			      const PointSet& y, bool most, double* h,
+			      double* dist) {
+
+  R_xlen_t k = y.n;
+  double inf = std::numeric_limits<double>::infinity();
+
+  R_xlen_t bj = -1;
+  double bd = most ? -inf : inf;
+
+  if (kind != DIST_HAVERSINE && kind != DIST_FAST &&
+      !dist_on_ellipsoid(kind)) {
+    double d[FUSE_BLOCK];
+    for (R_xlen_t jb = 0; jb < k; jb += FUSE_BLOCK) {
+      R_xlen_t jend = std::min(jb + FUSE_BLOCK, k);
+      batch_prep_1tom(kind, x, i, y, jb, jend, d);
+      for (R_xlen_t j = jb; j < jend; j++) {
+	if (std::isnan(d[j - jb])) {
+	  *dist = NA_REAL;
+	  return -1;
+	}
+	if (most ? d[j - jb] > bd : d[j - jb] < bd) {
+	  bd = d[j - jb];
+	  bj = j;
+	}
+      }
+    }
+    *dist = bd;
+    return bj;
+  }
+
+  double hlo, hhi;
+  haversine_terms(x, i, y, h, &hlo, &hhi);
+  double hb = most ? hhi : hlo;
+
+  if (std::isnan(hb)) {
+    *dist = NA_REAL;
+    return -1;
+  }
+
+  if (k == 0) {
+    *dist = hb;
+    return -1;
+  }
+
+  // distance the winner can be no farther (nearer) than, then the h of
+  // the farthest (nearest) point that could reach it
+  const double e2 = f * (2. - f);
+  double band = dist_on_ellipsoid(kind) ? (1. - e2) * sqrt(1. - e2) : 1.;
+  double cut = 2. * a * asin(sqrt(std::min(1., hb)));
+  double slack = GEO_REL_SLACK * cut + GEO_ABS_SLACK;
+  if (kind == DIST_FAST)
+    slack += FAST_MAX_ERROR;
+  cut = most ? std::max(0., cut * band - slack) : cut / band + slack;
+  double hc = sin(std::min(M_PI / 2, cut / (2. * a)));
+  hc *= hc;
+
+  for (R_xlen_t j = 0; j < k; j++) {
+    if (most ? h[j] < hc : h[j] > hc)
+      continue;
+    double d;
+    batch_prep_1tom(kind, x, i, y, j, j + 1, &d);
+    if (most ? d > bd : d < bd) {
+      bd = d;
+      bj = j;
+    }
+  }
+
+  *dist = bd;
+  return bj;
+
+}
+
+// k-d tree to search the ending points with: the one in geo index yindex,
+// or one built over yp into tmp; NULL where the tree cannot bound kind, or
+// yp is small or has missing points, and brute force is used instead. An
+// index over the wrong kind of coordinates is an error.
+static const GeoTree* end_tree(const GeoIndex* yindex, const PointSet* yp,
+			       int kind, GeoTree& tmp) {
+
+  bool planar = dist_is_planar(kind);
+
+  if (yindex != NULL && yindex->tree.planar != planar)
+    Rcpp::stop(planar ?
+	       "geo index is over longitude and latitude; build it with "
+	       "projected = TRUE for Euclidean or Manhattan distances" :
+	       "geo index is over projected coordinates; use it with "
+	       "Euclidean or Manhattan distances");
+
+  if (!geo_tree_supports(kind))
+    return NULL;
+
+  if (yindex != NULL)
+    return &yindex->tree;
+
+  if (yp->n <= GEO_LEAF || !finite_points(*yp, 0, yp->n))
+    return NULL;
+
+  geo_tree_build(tmp, yp->lon, yp->lat, yp->n, planar);
+  return &tmp;
+
+}
+
+// offer the distance from point i of x to every point of y to acc, as a
+// tree search would, FUSE_BLOCK at a time
+template <class Acc>
+static void brute_search(int kind, const PointSet& x, R_xlen_t i,
+			 const PointSet& y, Acc& acc) {
+
+  double d[FUSE_BLOCK];
+
+  for (R_xlen_t jb = 0; jb < y.n; jb += FUSE_BLOCK) {
+    R_xlen_t jend = std::min(jb + FUSE_BLOCK, y.n);
+    batch_prep_1tom(kind, x, i, y, jb, jend, d);
+    for (R_xlen_t j = jb; j < jend; j++)
+      acc.add(d[j - jb], j);
+  }
+
+}
+
+// values per node in ApproxTree::stats, and per mass in each
+#define APPROX_STATS 30
+#define APPROX_MASS 10
+
+// Ending points prepared for approx_row(): the tree, the point values in
+// tree order, and for each node the moments of its points under three
+// masses, v[j], v[j] * max(m[j], 0) and v[j] * max(-m[j], 0): the total,
+// the centroid of their sphere positions (meters) and the sums of
+// products of offsets from it, xx, xy, xz, yy, yz, zz. v and m are 1
+// where NULL.
+struct ApproxTree {
+
+  const GeoTree* t;
+  std::vector<double> v, m, stats;
+
+  // masses of all points, of v and of v * |m|
+  double tot_w, tot_a;
+
+};
+
+// moments s of the points under weights c at positions pos (3 per point)
+static void approx_moments(const double* c, const double* pos, int n,
+			   double* s) {
+
+  std::fill(s, s + APPROX_MASS, 0.);
+  for (int j = 0; j < n; j++) {
+    s[0] += c[j];
+    for (int k = 0; k < 3; k++)
+      s[1 + k] += c[j] * pos[3 * j + k];
+  }
+  if (s[0] == 0)
+    return;
+
+  for (int k = 0; k < 3; k++)
+    s[1 + k] /= s[0];
+  for (int j = 0; j < n; j++) {
+    double o[3];
+    for (int k = 0; k < 3; k++)
+      o[k] = pos[3 * j + k] - s[1 + k];
+    s[4] += c[j] * o[0] * o[0];
+    s[5] += c[j] * o[0] * o[1];
+    s[6] += c[j] * o[0] * o[2];
+    s[7] += c[j] * o[1] * o[1];
+    s[8] += c[j] * o[1] * o[2];
+    s[9] += c[j] * o[2] * o[2];
+  }
+
+}
+
+// moments s of the union of two sets of points with moments l and r
+static void approx_merge(const double* l, const double* r, double* s) {
+
+  s[0] = l[0] + r[0];
+  std::fill(s + 1, s + APPROX_MASS, 0.);
+  if (s[0] == 0)
+    return;
+
+  for (int k = 0; k < 3; k++)
+    s[1 + k] = (l[0] * l[1 + k] + r[0] * r[1 + k]) / s[0];
+
+  const double* part[2] = { l, r };
+  for (int h = 0; h < 2; h++) {
+    const double* p = part[h];
+    double o[3];
+    for (int k = 0; k < 3; k++)
+      o[k] = p[1 + k] - s[1 + k];
+    s[4] += p[4] + p[0] * o[0] * o[0];
+    s[5] += p[5] + p[0] * o[0] * o[1];
+    s[6] += p[6] + p[0] * o[0] * o[2];
+    s[7] += p[7] + p[0] * o[1] * o[1];
+    s[8] += p[8] + p[0] * o[1] * o[2];
+    s[9] += p[9] + p[0] * o[2] * o[2];
+  }
+
+}
+
+// fill at for the points of t with values v and m (input order)
+static void approx_tree(const GeoTree& t, const double* v, const double* m,
+			ApproxTree& at) {
+
+  R_xlen_t n = t.pts.n;
+  at.t = &t;
+  at.v.resize(n);
+  at.m.resize(n);
+  at.stats.assign(APPROX_STATS * t.n_nodes, 0.);
+
+  for (R_xlen_t j = 0; j < n; j++) {
+    at.v[j] = v != NULL ? v[t.perm[j]] : 1.;
+    at.m[j] = m != NULL ? m[t.perm[j]] : 1.;
+  }
+
+  // children come after their parent in t.nodes, so going backwards each
+  // node's children are done before it
+  double pos[3 * GEO_LEAF], c[3][GEO_LEAF];
+  for (R_xlen_t nc = t.n_nodes - 1; nc >= 0; nc--) {
+
+    const GeoNode& node = t.nodes[nc];
+    double* s = &at.stats[APPROX_STATS * nc];
+
+    if (node.left >= 0) {
+      const double* l = &at.stats[APPROX_STATS * node.left];
+      const double* r = &at.stats[APPROX_STATS * node.right];
+      for (int k = 0; k < 3; k++)
+	approx_merge(l + APPROX_MASS * k, r + APPROX_MASS * k,
+		     s + APPROX_MASS * k);
+      continue;
+    }
+
+    int nl = node.hi - node.lo;
+    for (int h = 0; h < nl; h++) {
+      R_xlen_t j = node.lo + h;
+      pos[3 * h] = a * t.pts.clat[j] * cos(t.pts.lonr[j]);
+      pos[3 * h + 1] = a * t.pts.clat[j] * sin(t.pts.lonr[j]);
+      pos[3 * h + 2] = a * sin(t.pts.latr[j]);
+      c[0][h] = at.v[j];
+      c[1][h] = at.v[j] * std::max(at.m[j], 0.);
+      c[2][h] = at.v[j] * std::max(-at.m[j], 0.);
+    }
+    for (int k = 0; k < 3; k++)
+      approx_moments(c[k], pos, nl, s + APPROX_MASS * k);
+
+  }
+
+  const double* root = at.stats.data();
+  at.tot_w = t.n_nodes > 0 ? root[0] : 0;
+  at.tot_a = t.n_nodes > 0 ? root[APPROX_MASS] + root[2 * APPROX_MASS] : 0;
+
+}
+
+// node waiting to be opened by approx_row(), with its distance range and
+// the weights at either end (NaN where they do not bound the weights)
+struct OpenNode {
+
+  double near, far;
+  int c;
+  double kmin, kmax;
+
+  // nearest first from a std::priority_queue
+  bool operator<(const OpenNode& o) const { return near > o.near; }
+
+};
+
+// |w'| and |w''| of the weight at transformed distance t, from its value
+// w there; both fall with t, with the log transform past 1
+static void weight_slopes(bool log_transform, double decay, double t,
+			  double w, double* w1, double* w2) {
+
+  if (log_transform) {
+    double lt = log(t);
+    *w1 = decay * w / (lt * t);
+    *w2 = decay * w * ((decay + 1) / lt + 1) / (lt * t * t);
+  } else {
+    *w1 = decay * w / t;
+    *w2 = decay * (decay + 1) * w / (t * t);
+  }
+
+}
+
+// Sums over the points j of tree at.t of w_j = weight(d_ij / scale) v[j]
+// and of w_j m[j], as idw_rows() and inv_sum_row() form them, with whole
+// nodes approximated. With Haversine distances the squared chord u is
+// linear in a point's position, so each mass of a node times the weight
+// g(u) at the u of its centroid is off by at most max |g''| / 2 times the
+// mass-weighted sum of squares of u about it, which follows from the
+// node's moments. Otherwise each mass times the middle of the weights at
+// either end of the node's distance range is off by at most the mass
+// times half their difference. A node is accepted when the errors are no
+// more than tol times its share of all mass times a lower bound on the
+// whole sum (from exact leaves and the weight ranges of other nodes), so
+// the errors add up to at most tol of each sum (of absolute values, for
+// the measure). Nodes are opened nearest first, which raises the lower
+// bound quickly. Leaves that are not accepted are summed exactly;
+// infinite weights are skipped there if skip_inf.
+template <class W>
+static void approx_row(int kind, const PointSet& x, R_xlen_t i,
+		       const ApproxTree& at, const W& weight,
+		       bool log_transform, double scale, double tol,
+		       bool skip_inf, std::vector<OpenNode>& heap,
+		       double* w_out, double* m_out) {
+
+  const GeoTree& t = *at.t;
+  const double four_a2 = 4. * a * a;
+  const int mw = 0, mp = APPROX_MASS, mn = 2 * APPROX_MASS;
+
+  double q[6];
+  geo_tree_query(kind, x, i, q);
+
+  double d[GEO_LEAF];
+  double w_sum = 0;
+  double sum = 0;
+
+  // lower and upper bounds on the weight sum and the absolute measure
+  // sum; n_open nodes have no upper bound
+  double low_w = 0, up_w = 0;
+  double low_a = 0, up_a = 0;
+  R_xlen_t n_open = 0;
+
+  // nodes to add to the heap
+  int pending[2];
+  int np = 0;
+  if (t.n_nodes > 0)
+    pending[np++] = 0;
+
+  heap.clear();
+
+  while (true) {
+
+    for (int p = 0; p < np; p++) {
+
+      OpenNode o;
+      o.c = pending[p];
+      geo_node_range(t.nodes[o.c], kind, q, &o.near, &o.far);
+      o.kmin = o.kmax = NA_REAL;
+
+      // the log transform is only monotone past 1
+      if (!log_transform || o.near / scale > 1) {
+	double kl = weight(o.near / scale);
+	double kh = weight(o.far / scale);
+	o.kmin = std::min(kl, kh);
+	o.kmax = std::max(kl, kh);
+	if (o.kmin > 0) {
+	  const double* s = &at.stats[APPROX_STATS * o.c];
+	  low_w += o.kmin * s[mw];
+	  low_a += o.kmin * (s[mp] + s[mn]);
+	}
+      }
+      if (std::isfinite(o.kmax)) {
+	const double* s = &at.stats[APPROX_STATS * o.c];
+	up_w += o.kmax * s[mw];
+	up_a += o.kmax * (s[mp] + s[mn]);
+      } else {
+	n_open++;
+      }
+
+      heap.push_back(o);
+      std::push_heap(heap.begin(), heap.end());
+
+    }
+
+    np = 0;
+    if (heap.empty())
+      break;
+
+    std::pop_heap(heap.begin(), heap.end());
+    OpenNode o = heap.back();
+    heap.pop_back();
+
+    const GeoNode& node = t.nodes[o.c];
+    const double* s = &at.stats[APPROX_STATS * o.c];
+
+    if (o.kmin > 0 && std::isfinite(o.kmax)) {
+
+      // half of tol by mass, half by the node's least part of the sum
+      double mass_a = s[mp] + s[mn];
+      double share_w = s[mw] == 0 ? 0 : tol / 2 * low_w * s[mw] *
+	(1 / at.tot_w + (n_open == 0 ? o.kmin / up_w : 0));
+      double share_a = mass_a == 0 ? 0 : tol / 2 * low_a * mass_a *
+	(1 / at.tot_a + (n_open == 0 ? o.kmin / up_a : 0));
+
+      // weight at the centroid
+      if (kind == DIST_HAVERSINE && weight.decay > 0 && o.near > 0) {
+
+	double ulo = std::pow(2. * a * sin(std::min(o.near / (2. * a),
+						    M_PI / 2)), 2);
+	double uhi = std::pow(2. * a * sin(std::min(o.far / (2. * a),
+						    M_PI / 2)), 2);
+
+	// |g''| <= |K''| d'^2 + |K'| |d''| for K the weight in meters and
+	// d = 2 a asin(sqrt(u) / (2 a)), d'^2 = 1 / (4 phi) and
+	// |d''| <= 1 / (4 phi^1.5), phi = u (1 - u / (4 a^2)) smallest at
+	// an end of the range
+	double phi = std::min(ulo * (1. - ulo / four_a2),
+			      uhi * (1. - uhi / four_a2));
+	double w1, w2;
+	weight_slopes(log_transform, weight.decay, o.near / scale, o.kmax,
+		      &w1, &w2);
+	double g2 = w2 / (scale * scale) / (4. * phi) +
+	  w1 / scale / (4. * phi * std::sqrt(phi));
+
+	// u - u_centroid = -2 q . (p - centroid), so the sum of squares is
+	// 4 q' S q, and no more than (du)^2 / 4 per unit mass
+	double err[3];
+	for (int k = 0; k < 3; k++) {
+	  const double* sk = s + APPROX_MASS * k;
+	  double qsq =
+	    q[0] * (q[0] * sk[4] + 2. * (q[1] * sk[5] + q[2] * sk[6])) +
+	    q[1] * (q[1] * sk[7] + 2. * q[2] * sk[8]) +
+	    q[2] * q[2] * sk[9];
+	  err[k] = g2 / 2. * std::min(4. * std::max(qsq, 0.),
+				      sk[0] * (uhi - ulo) * (uhi - ulo) / 4.);
+	}
+
+	if (phi > 0 && err[0] <= share_w && err[1] + err[2] <= share_a) {
+	  // its share of the lower bounds stays counted
+	  for (int k = 0; k < 3; k++) {
+	    const double* sk = s + APPROX_MASS * k;
+	    if (sk[0] == 0) continue;
+	    double u = 2. * a * a - 2. * (q[0] * sk[1] + q[1] * sk[2] +
+					  q[2] * sk[3]);
+	    u = std::min(uhi, std::max(ulo, u));
+	    double w = sk[0] * weight(2. * a * asin(std::sqrt(u / four_a2)) /
+				      scale);
+	    if (k == 0) w_sum += w;
+	    else if (k == 1) sum += w;
+	    else sum -= w;
+	  }
+	  continue;
+	}
+
+      }
+
+      // middle of the weight range
+      double half = (o.kmax - o.kmin) / 2;
+      if (half * s[mw] <= share_w && half * mass_a <= share_a) {
+	double kmid = (o.kmin + o.kmax) / 2;
+	w_sum += kmid * s[mw];
+	sum += kmid * (s[mp] - s[mn]);
+	continue;
+      }
+
+    }
+
+    // otherwise its children or its points replace it in the lower bounds
+    if (o.kmin > 0) {
+      low_w -= o.kmin * s[mw];
+      low_a -= o.kmin * (s[mp] + s[mn]);
+    }
+    if (std::isfinite(o.kmax)) {
+      up_w -= o.kmax * s[mw];
+      up_a -= o.kmax * (s[mp] + s[mn]);
+    } else {
+      n_open--;
+    }
+
+    if (node.left >= 0) {
+      pending[0] = node.left;
+      pending[1] = node.right;
+      np = 2;
+      continue;
+    }
+
+    // exact sums for the leaf
+    batch_prep_1tom(kind, x, i, t.pts, node.lo, node.hi, d);
+
+    for (R_xlen_t j = node.lo; j < node.hi; j++) {
+      double w = weight(d[j - node.lo] / scale);
+      if (skip_inf && std::isinf(w)) continue;
+      w *= at.v[j];
+      w_sum += w;
+      sum += w * at.m[j];
+      if (w > 0) {
+	low_w += w;
+	low_a += w * std::fabs(at.m[j]);
+      }
+      up_w += w;
+      up_a += w * std::fabs(at.m[j]);
+    }
+
+  }
+
+  *w_out = w_sum;
+  *m_out = sum;
+
+}
+
+// Means as idw_rows() over only the ending points within max_dist of
+// each point of x, and of those the k nearest if k > 0, found through
+// tree t or, where it is NULL, by brute force. Points are summed in input
+// order, so results do not depend on how they are found; rows with no
+// such points, or missing coordinates, are NA.
+template <class W>
+static void local_rows(R_xlen_t lo, R_xlen_t hi, int kind,
+		       const PointSet& x, const PointSet& y, const GeoTree* t,
+		       const double* meas, const double* pop, double max_dist,
+		       int k, const W& weight, double* out) {
+
+  GeoKnn knn;
+  knn.k = k;
+  knn.radius = max_dist;
+  GeoWithin within;
+  within.radius = max_dist;
+
+  for (R_xlen_t i = lo; i < hi; i++) {
+
+    out[i] = NA_REAL;
+    if (!finite_points(x, i, i + 1))
+      continue;
+
+    within.hits.clear();
+    if (k > 0) {
+      knn.heap.clear();
+      if (t != NULL)
+	geo_tree_knn(*t, kind, x, i, knn);
+      else
+	brute_search(kind, x, i, y, knn);
+      for (size_t h = 0; h < knn.heap.size(); h++)
+	within.hits.push_back(std::make_pair(knn.heap[h].second,
+					     knn.heap[h].first));
+    } else if (t != NULL) {
+      geo_tree_within(*t, kind, x, i, within);
+    } else {
+      brute_search(kind, x, i, y, within);
+    }
+
+    if (within.hits.empty())
+      continue;
+    std::sort(within.hits.begin(), within.hits.end());
+
+    double w_sum = 0;
+    double sum = 0;
+    for (size_t h = 0; h < within.hits.size(); h++) {
+      R_xlen_t j = within.hits[h].first;
+      double w = weight(within.hits[h].second);
+      if (pop != NULL) w *= pop[j];
+      w_sum += w;
+      sum += w * meas[j];
+    }
+
+    out[i] = sum / w_sum;
+
+  }
+
+}
+
+// inverse-distance-weighted means of meas at the points of y for every
+// point of x into out, pop may be NULL; over only nearby points of y if
+// max_dist is finite or k > 0, otherwise approximated where tolerance > 0,
+// in both cases through a k-d tree over y (from index yindex, if any)
+// where there is one
+static void idw_means(int kind, const PointSet& x, const PointSet& y,
+		      const GeoIndex* yindex, const double* meas,
+		      const double* pop, bool log_transform, double decay,
+		      double tolerance, double max_dist, int k, int nt,
+		      double* out) {
+
+  if (!(tolerance >= 0))
+    Rcpp::stop("tolerance must be zero or more");
+  if (!(max_dist >= 0))
+    Rcpp::stop("max_dist must be zero or more");
+  if (k < 0)
+    Rcpp::stop("k_neighbors must be zero or more");
+
+  bool local = k > 0 || max_dist < R_PosInf;
+
+  GeoTree tree;
+  const GeoTree* ytree = NULL;
+  if (local || tolerance > 0)
+    ytree = end_tree(yindex, &y, kind, tree);
+
+  // rows are independent and each is summed serially, so results do not
+  // depend on the number of threads
+  if (local) {
+    WEIGHT_DISPATCH(log_transform, decay, W, weight,
+      parallel_for(x.n, 16, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+	  local_rows(lo, hi, kind, x, y, ytree, meas, pop, max_dist, k,
+		     weight, out);
+	}));
+    return;
+  }
+
+  if (ytree == NULL) {
+    WEIGHT_DISPATCH(log_transform, decay, W, weight,
+      parallel_for(x.n, row_grain(y.n), nt, [&](R_xlen_t lo, R_xlen_t hi) {
+	  idw_rows(lo, hi, kind, x, y, meas, pop, weight, out);
+	}));
+    return;
+  }
+
+  ApproxTree at;
+  approx_tree(*ytree, pop, meas, at);
+
+  WEIGHT_DISPATCH(log_transform, decay, W, weight,
+    parallel_for(x.n, 16, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+	std::vector<OpenNode> heap;
+	for (R_xlen_t i = lo; i < hi; i++) {
+	  double w_sum, sum;
+	  approx_row(kind, x, i, at, weight, log_transform, 1., tolerance,
+		     false, heap, &w_sum, &sum);
+	  out[i] = sum / w_sum;
+	}
+      }));
 
 }
 
@@ -149,8 +1142,31 @@ double dist_1to1(const double& xlon,
 //' surrounding measures taken in nearby areas and those with greater
 //' populations are given more weight in final average.
 //'
-//' @param x_df DataFrame with coordinates that need weighted measures
-//' @param y_df DataFrame with coordinates at which measures were taken
+//' With \code{tolerance} above 0 the means are approximated. Ending points
+//' are grouped by the k-d tree of \code{dist_min()}, and a group whose
+//' error bound fits its share of the allowance counts through its totals,
+//' weighted at its centroid (Haversine) or at the middle of its weight
+//' range; nearby points are summed exactly. The weight total and, for
+//' nonnegative measures, the weighted measure total are each within a
+//' relative error of \code{tolerance}, so means are within about twice
+//' that. Each starting point then needs distances to nearby ending points
+//' and to a number of groups that grows slowly with their count, rather
+//' than to every ending point; pass an index from
+//' \code{geo_index_build()} as \code{y_df} to build the tree only once.
+//' Ending points with missing coordinates are always summed exactly.
+//'
+//' \code{max_dist} and \code{k_neighbors} make the means local (Shepard's
+//' method): only ending points within \code{max_dist} meters, and of those
+//' the \code{k_neighbors} nearest (ties to the earlier row), are weighted.
+//' They are found through the same k-d tree, so distant ending points are
+//' never visited, and are summed exactly; \code{tolerance} is then not
+//' used. Starting points with no ending points in range get \code{NA}.
+//'
+//' @param x_df DataFrame with coordinates that need weighted measures, or
+//' prepared point set built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with coordinates at which measures were taken, or
+//' prepared point set or geo index built from one (see
+//' \code{geo_index_build()})
 //' @param measure_col String name of measure column in y_df
 //' @param x_id String name of unique identifer column in x_df
 //' @param x_lon_col String name of column in x_df with longitude values
@@ -158,16 +1174,26 @@ double dist_1to1(const double& xlon,
 //' @param y_lon_col String name of column in y_df with longitude values
 //' @param y_lat_col String name of column in y_df with latitude values
 //' @param pop_col String name of column in x_df with population values
-//' @param dist_function String name of distance function: "Haversine" (default) or
-//' "Vincenty"
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
 //' @param dist_transform String value of distance weight transform: "level" (default)
 //' or "log"
 //' @param decay Numeric value of distance weight decay: 2 (default)
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @param tolerance Numeric relative error allowed; 0 (default) computes
+//' exact means, see Details
+//' @param max_dist Numeric distance in meters past which ending points
+//' are not weighted; \code{Inf} (default) weights all of them
+//' @param k_neighbors Integer number of nearest ending points weighted; 0
+//' (default) weights all of them
 //' @return Dataframe of population/distance-weighted values
 //' @export
 // [[Rcpp::export]]
-Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df,
-				      Rcpp::DataFrame y_df,
+Rcpp::DataFrame popdist_weighted_mean(SEXP x_df,
+				      SEXP y_df,
 				      std::string measure_col,
 				      std::string x_id = "id",
 				      std::string x_lon_col = "lon",
@@ -177,56 +1203,39 @@ Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df,
 				      std::string pop_col = "pop",
 				      std::string dist_function = "Haversine",
 				      std::string dist_transform = "level",
-				      double decay = 2) {
+				      double decay = 2,
+				      int nthreads = 0,
+				      double tolerance = 0,
+				      double max_dist = R_PosInf,
+				      int k_neighbors = 0) {
 
   // init
-  Rcpp::CharacterVector id = x_df[x_id];
-  Rcpp::NumericVector xlon = x_df[x_lon_col];
-  Rcpp::NumericVector xlat = x_df[x_lat_col];
-  Rcpp::NumericVector meas = y_df[measure_col];
-  Rcpp::NumericVector ylon = y_df[y_lon_col];
-  Rcpp::NumericVector ylat = y_df[y_lat_col];
-  Rcpp::NumericVector popw = y_df[pop_col];
-
-  int n = xlon.size();
-  int k = ylon.size();
-  Rcpp::NumericVector out(n);
+  Rcpp::DataFrame xf = frame_of(x_df);
+  Rcpp::DataFrame yf = frame_of(y_df);
+  Rcpp::CharacterVector id = xf[x_id];
+  Rcpp::NumericVector meas = yf[measure_col];
+  Rcpp::NumericVector popw = yf[pop_col];
 
-  // loop to compute
-  for (int i = 0; i < n; i++) {
+  // every y point is paired with every x row, so prepare both once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const PointSet& yp = frame_points(y_df, y_lon_col, y_lat_col, ytmp);
 
-    // check for interrupt
-    if(i % 1000 == 0)
-      Rcpp::checkUserInterrupt();
-
-    // distance vector
-    Rcpp::NumericVector dist = dist_1tom(xlon[i], xlat[i],
-					 ylon, ylat, dist_function);
-
-    // inverse distance weights
-    Rcpp::NumericVector idw = inverse_value(dist, decay, dist_transform);
-
-    // population adjusted idw
-    Rcpp::NumericVector w = idw * popw;
-
-    // weight denominator
-    double w_sum = 0;
-    for (int j = 0; j < k; j++) {
-      w_sum += w[j];
-    }
-
-    // weight the measure_i
-    Rcpp::NumericVector tmp = (w * meas) / (w_sum);
+  // select function
+  int kind = dist_kind_of(dist_function);
 
-    // sum the wmeasure_i
-    double sum = 0;
-    for (int j = 0; j < k; j++) {
-      sum += tmp[j];
-    }
+  int n = xp.n;
+  int nt = resolve_threads(nthreads);
+  bool log_transform = (dist_transform == "log");
+  Rcpp::NumericVector out(n);
 
-    out[i] = sum;
+  // raw buffers for worker threads
+  const double* me = meas.begin();
+  const double* pw = popw.begin();
+  double* res = out.begin();
 
-  }
+  idw_means(kind, xp, yp, as_geo_index(y_df), me, pw, log_transform, decay,
+	    tolerance, max_dist, k_neighbors, nt, res);
 
   return Rcpp::DataFrame::create(Rcpp::Named("id") = id,
 				 Rcpp::Named("wmeasure") = out,
@@ -242,24 +1251,57 @@ Rcpp::DataFrame popdist_weighted_mean(Rcpp::DataFrame x_df,
 //' surrounding measures taken in nearby areas are given more weight in final
 //' average.
 //'
-//' @param x_df DataFrame with coordinates that need weighted measures
-//' @param y_df DataFrame with coordinates at which measures were taken
+//' With \code{tolerance} above 0 the means are approximated. Ending points
+//' are grouped by the k-d tree of \code{dist_min()}, and a group whose
+//' error bound fits its share of the allowance counts through its totals,
+//' weighted at its centroid (Haversine) or at the middle of its weight
+//' range; nearby points are summed exactly. The weight total and, for
+//' nonnegative measures, the weighted measure total are each within a
+//' relative error of \code{tolerance}, so means are within about twice
+//' that. Each starting point then needs distances to nearby ending points
+//' and to a number of groups that grows slowly with their count, rather
+//' than to every ending point; pass an index from
+//' \code{geo_index_build()} as \code{y_df} to build the tree only once.
+//' Ending points with missing coordinates are always summed exactly.
+//'
+//' \code{max_dist} and \code{k_neighbors} make the means local (Shepard's
+//' method): only ending points within \code{max_dist} meters, and of those
+//' the \code{k_neighbors} nearest (ties to the earlier row), are weighted.
+//' They are found through the same k-d tree, so distant ending points are
+//' never visited, and are summed exactly; \code{tolerance} is then not
+//' used. Starting points with no ending points in range get \code{NA}.
+//'
+//' @param x_df DataFrame with coordinates that need weighted measures, or
+//' prepared point set built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with coordinates at which measures were taken, or
+//' prepared point set or geo index built from one (see
+//' \code{geo_index_build()})
 //' @param measure_col String name of measure column in y_df
 //' @param x_id String name of unique identifer column in x_df
 //' @param x_lon_col String name of column in x_df with longitude values
 //' @param x_lat_col String name of column in x_df with latitude values
 //' @param y_lon_col String name of column in y_df with longitude values
 //' @param y_lat_col String name of column in y_df with latitude values
-//' @param dist_function String name of distance function: "Haversine" (default) or
-//' "Vincenty"
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
 //' @param dist_transform String value of distance weight transform: "level" (default)
 //' or "log"
 //' @param decay Numeric value of distance weight decay: 2 (default)
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @param tolerance Numeric relative error allowed; 0 (default) computes
+//' exact means, see Details
+//' @param max_dist Numeric distance in meters past which ending points
+//' are not weighted; \code{Inf} (default) weights all of them
+//' @param k_neighbors Integer number of nearest ending points weighted; 0
+//' (default) weights all of them
 //' @return Dataframe of distance-weighted values
 //' @export
 // [[Rcpp::export]]
-Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df,
-				   Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_weighted_mean(SEXP x_df,
+				   SEXP y_df,
 				   std::string measure_col,
 				   std::string x_id = "id",
 				   std::string x_lon_col = "lon",
@@ -268,56 +1310,58 @@ Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df,
 				   std::string y_lat_col = "lat",
 				   std::string dist_function = "Haversine",
 				   std::string dist_transform = "level",
-				   double decay = 2) {
+				   double decay = 2,
+				   int nthreads = 0,
+				   double tolerance = 0,
+				   double max_dist = R_PosInf,
+				   int k_neighbors = 0) {
 
   // init
-  Rcpp::CharacterVector id = x_df[x_id];
-  Rcpp::NumericVector xlon = x_df[x_lon_col];
-  Rcpp::NumericVector xlat = x_df[x_lat_col];
-  Rcpp::NumericVector meas = y_df[measure_col];
-  Rcpp::NumericVector ylon = y_df[y_lon_col];
-  Rcpp::NumericVector ylat = y_df[y_lat_col];
-
-  int n = xlon.size();
-  int k = ylon.size();
-  Rcpp::NumericVector out(n);
+  Rcpp::DataFrame xf = frame_of(x_df);
+  Rcpp::DataFrame yf = frame_of(y_df);
+  Rcpp::CharacterVector id = xf[x_id];
+  Rcpp::NumericVector meas = yf[measure_col];
 
-  // loop to compute
-  for (int i = 0; i < n; i++) {
+  // every y point is paired with every x row, so prepare both once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const PointSet& yp = frame_points(y_df, y_lon_col, y_lat_col, ytmp);
 
-    // check for interrupt
-    if(i % 1000 == 0)
-      Rcpp::checkUserInterrupt();
+  // select function
+  int kind = dist_kind_of(dist_function);
 
-    // distance vector
-    Rcpp::NumericVector dist = dist_1tom(xlon[i], xlat[i],
-					 ylon, ylat, dist_function);
+  int n = xp.n;
+  int nt = resolve_threads(nthreads);
+  bool log_transform = (dist_transform == "log");
+  Rcpp::NumericVector out(n);
 
-    // inverse distance weights
-    Rcpp::NumericVector w = inverse_value(dist, decay, dist_transform);
+  // raw buffers for worker threads
+  const double* me = meas.begin();
+  const double* pw = NULL;
+  double* res = out.begin();
 
-    // weight denominator
-    double w_sum = 0;
-    for (int j = 0; j < k; j++) {
-      w_sum += w[j];
-    }
+  idw_means(kind, xp, yp, as_geo_index(y_df), me, pw, log_transform, decay,
+	    tolerance, max_dist, k_neighbors, nt, res);
 
-    // weight the measure_i
-    Rcpp::NumericVector tmp = (w * meas) / (w_sum);
+  return Rcpp::DataFrame::create(Rcpp::Named("id") = id,
+				 Rcpp::Named("wmeasure") = out,
+				 Rcpp::Named("stringsAsFactors") = false);
 
-    // sum the wmeasure_i
-    double sum = 0;
-    for (int j = 0; j < k; j++) {
-      sum += tmp[j];
-    }
+}
 
-    out[i] = sum;
+// ids of ending points at rows, from column y_id of the data frame behind
+// y_df or, for a geo index loaded without one, from the index
+static Rcpp::CharacterVector end_ids(SEXP y_df, std::string y_id,
+				     const std::vector<R_xlen_t>& rows) {
 
-  }
+  const GeoIndex* g = as_geo_index(y_df);
 
-  return Rcpp::DataFrame::create(Rcpp::Named("id") = id,
-				 Rcpp::Named("wmeasure") = out,
-				 Rcpp::Named("stringsAsFactors") = false);
+  if (g != NULL && g->id_off != NULL &&
+      TYPEOF(R_ExternalPtrProtected(y_df)) != VECSXP)
+    return geo_index_ids(*g, rows);
+
+  Rcpp::DataFrame yf = frame_of(y_df);
+  return ids_at(yf[y_id], rows);
 
 }
 
@@ -326,21 +1370,39 @@ Rcpp::DataFrame dist_weighted_mean(Rcpp::DataFrame x_df,
 //' Find minimum distance between each starting point in \strong{x} and
 //' possible end points, \strong{y}.
 //'
-//' @param x_df DataFrame with starting coordinates
-//' @param y_df DataFrame with ending coordinates
+//' Ending points are searched through a k-d tree on their positions in
+//' three dimensions, so each starting point needs about log(k) rather than
+//' k distance calculations. Results are the same as comparing every pair,
+//' with ties going to the first ending point in \strong{y}. Where there
+//' is no tree (few or missing ending points), pairs are compared on the
+//' haversine term, which orders them as their distances do, and only the
+//' closest get full distances. Vincenty and Karney distances are computed
+//' only for ending points whose Haversine distance puts them in reach of
+//' the nearest; Andoyer and Thomas distances are computed for every
+//' ending point, without the tree. Euclidean and Manhattan distances use
+//' a tree built in the plane; an index passed as \code{y_df} must then be
+//' built with \code{projected = TRUE}.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()}) or loaded
+//' from a file (see \code{geo_index_load()})
 //' @param x_id String name of unique identifer column in x_df
-//' @param y_id String name of unique identifer column in y_df
+//' @param y_id String name of unique identifer column in y_df; ignored
+//' for a geo index loaded without its data frame, which has the ids
 //' @param x_lon_col String name of column in x_df with longitude values
 //' @param x_lat_col String name of column in x_df with latitude values
 //' @param y_lon_col String name of column in y_df with longitude values
 //' @param y_lat_col String name of column in y_df with latitude values
-//' @param dist_function String name of distance function: "Haversine" (default) or
-//' "Vincenty"
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
 //' @return DataFrame with id of closest point and distance in meters
 //' @export
 // [[Rcpp::export]]
-Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
-			 Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_min(SEXP x_df,
+			 SEXP y_df,
 			 std::string x_id = "id",
 			 std::string y_id = "id",
 			 std::string x_lon_col = "lon",
@@ -350,16 +1412,33 @@ Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
 			 std::string dist_function = "Haversine") {
 
   // init
-  Rcpp::CharacterVector idx = x_df[x_id];
-  Rcpp::CharacterVector idy = y_df[y_id];
-  Rcpp::NumericVector xlon = x_df[x_lon_col];
-  Rcpp::NumericVector xlat = x_df[x_lat_col];
-  Rcpp::NumericVector ylon = y_df[y_lon_col];
-  Rcpp::NumericVector ylat = y_df[y_lat_col];
-
-  int n = xlon.size();
+  Rcpp::DataFrame xf = frame_of(x_df);
+  Rcpp::CharacterVector idx = xf[x_id];
+
+  // every y point is paired with every x row, so prepare both once; a
+  // geo index over y already has its tree, and its points are only read
+  // if a starting point needs brute force
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const GeoIndex* yindex = as_geo_index(y_df);
+  const PointSet* yp = NULL;
+  if (yindex == NULL)
+    yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  int n = xp.n;
   Rcpp::NumericVector dist(n);
-  Rcpp::CharacterVector end(n);
+  std::vector<R_xlen_t> end(n);
+
+  // haversine terms, reused across rows
+  std::vector<double> hrow;
+
+  // search a k-d tree over y where there is one; brute force below gives
+  // the same result
+  GeoTree tree;
+  const GeoTree* ytree = end_tree(yindex, yp, kind, tree);
 
   // loop
   for (int i = 0; i < n; i++) {
@@ -368,22 +1447,29 @@ Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
     if(i % 1000 == 0)
       Rcpp::checkUserInterrupt();
 
-    // distance vector
-    Rcpp::NumericVector distvec = dist_1tom(xlon[i], xlat[i],
-					    ylon, ylat, dist_function);
+    // nearest point from tree
+    if (ytree != NULL && finite_points(xp, i, i + 1)) {
+      double d;
+      R_xlen_t j = geo_tree_nearest(*ytree, kind, xp, i, &d);
+      dist[i] = d;
+      end[i] = j;
+      continue;
+    }
 
-    // add minimum to distance output
-    dist[i] = min(distvec);
+    // ending points, read on first use for an index
+    if (yp == NULL)
+      yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+    hrow.resize(yp->n);
 
-    // get ID of minimum
-    int j;
-    j = which_min(distvec);
-    end[i] = idy[j];
+    // minimum distance and its ID
+    double d;
+    end[i] = extreme_point(kind, xp, i, *yp, false, hrow.data(), &d);
+    dist[i] = d;
 
   }
 
   return Rcpp::DataFrame::create(Rcpp::Named("id_start") = idx,
-				 Rcpp::Named("id_end") = end,
+				 Rcpp::Named("id_end") = end_ids(y_df, y_id, end),
 				 Rcpp::Named("meters") = dist,
 				 Rcpp::Named("stringsAsFactors") = false);
 
@@ -394,21 +1480,33 @@ Rcpp::DataFrame dist_min(Rcpp::DataFrame x_df,
 //' Find maximum distance between each starting point in \strong{x} and
 //' possible end points, \strong{y}.
 //'
-//' @param x_df DataFrame with starting coordinates
-//' @param y_df DataFrame with ending coordinates
+//' Pairs are compared on the haversine term, which orders them as their
+//' distances do and costs a few multiplications, and only the farthest
+//' get full distances; for Vincenty and Karney, those whose Haversine
+//' distance puts them in reach of the farthest. Andoyer, Thomas,
+//' Euclidean and Manhattan distances are computed for every ending point.
+//' Ties go to the first ending point in \strong{y}.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()}) or loaded
+//' from a file (see \code{geo_index_load()})
 //' @param x_id String name of unique identifer column in x_df
-//' @param y_id String name of unique identifer column in y_df
+//' @param y_id String name of unique identifer column in y_df; ignored
+//' for a geo index loaded without its data frame, which has the ids
 //' @param x_lon_col String name of column in x_df with longitude values
 //' @param x_lat_col String name of column in x_df with latitude values
 //' @param y_lon_col String name of column in y_df with longitude values
 //' @param y_lat_col String name of column in y_df with latitude values
-//' @param dist_function String name of distance function: "Haversine" (default) or
-//' "Vincenty"
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
 //' @return DataFrame with id of farthest point and distance in meters
 //' @export
 // [[Rcpp::export]]
-Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df,
-			 Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_max(SEXP x_df,
+			 SEXP y_df,
 			 std::string x_id = "id",
 			 std::string y_id = "id",
 			 std::string x_lon_col = "lon",
@@ -418,16 +1516,23 @@ Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df,
 			 std::string dist_function = "Haversine") {
 
   // init
-  Rcpp::CharacterVector idx = x_df[x_id];
-  Rcpp::CharacterVector idy = y_df[y_id];
-  Rcpp::NumericVector xlon = x_df[x_lon_col];
-  Rcpp::NumericVector xlat = x_df[x_lat_col];
-  Rcpp::NumericVector ylon = y_df[y_lon_col];
-  Rcpp::NumericVector ylat = y_df[y_lat_col];
-
-  int n = xlon.size();
+  Rcpp::DataFrame xf = frame_of(x_df);
+  Rcpp::CharacterVector idx = xf[x_id];
+
+  // every y point is paired with every x row, so prepare both once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const PointSet& yp = frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  int n = xp.n;
   Rcpp::NumericVector dist(n);
-  Rcpp::CharacterVector end(n);
+  std::vector<R_xlen_t> end(n);
+
+  // haversine terms, reused across rows
+  std::vector<double> hrow(yp.n);
 
   // loop
   for (int i = 0; i < n; i++) {
@@ -436,51 +1541,645 @@ Rcpp::DataFrame dist_max(Rcpp::DataFrame x_df,
     if(i % 1000 == 0)
       Rcpp::checkUserInterrupt();
 
-    // distance vector
-    Rcpp::NumericVector distvec = dist_1tom(xlon[i], xlat[i],
-					    ylon, ylat, dist_function);
-
-    // add maximum to distance output
-    dist[i] = max(distvec);
-
-    // get ID of maximum
-    int j;
-    j = which_max(distvec);
-    end[i] = idy[j];
+    // maximum distance and its ID
+    double d;
+    end[i] = extreme_point(kind, xp, i, yp, true, hrow.data(), &d);
+    dist[i] = d;
 
   }
 
   return Rcpp::DataFrame::create(Rcpp::Named("id_start") = idx,
-				 Rcpp::Named("id_end") = end,
+				 Rcpp::Named("id_end") = end_ids(y_df, y_id, end),
 				 Rcpp::Named("meters") = dist,
 				 Rcpp::Named("stringsAsFactors") = false);
 
 }
 
+//' Find nearest k distances.
+//'
+//' Find the \code{k} ending points in \strong{y} closest to each starting
+//' point in \strong{x}, with their distances.
+//'
+//' Each starting point keeps only its \code{k} best ending points so far,
+//' and ending points are searched through the same k-d tree as in
+//' \code{dist_min()}, so the full distance vector is never held. Ties go
+//' to the first ending point in \strong{y}. Starting points with missing
+//' coordinates, and ending points with missing coordinates, have no rows.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()}) or loaded
+//' from a file (see \code{geo_index_load()})
+//' @param k Number of nearest ending points to return per starting point
+//' @param x_id String name of unique identifer column in x_df
+//' @param y_id String name of unique identifer column in y_df; ignored
+//' for a geo index loaded without its data frame, which has the ids
+//' @param x_lon_col String name of column in x_df with longitude values
+//' @param x_lat_col String name of column in x_df with latitude values
+//' @param y_lon_col String name of column in y_df with longitude values
+//' @param y_lat_col String name of column in y_df with latitude values
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
+//' @return DataFrame with one row per starting point and neighbour: id of
+//' starting point, rank (1 for the closest), id of ending point and
+//' distance in meters, ordered by starting point then rank
+//' @export
+// [[Rcpp::export]]
+Rcpp::DataFrame dist_knn(SEXP x_df,
+			 SEXP y_df,
+			 int k,
+			 std::string x_id = "id",
+			 std::string y_id = "id",
+			 std::string x_lon_col = "lon",
+			 std::string x_lat_col = "lat",
+			 std::string y_lon_col = "lon",
+			 std::string y_lat_col = "lat",
+			 std::string dist_function = "Haversine") {
+
+  // init
+  Rcpp::DataFrame xf = frame_of(x_df);
+  SEXP idx = xf[x_id];
+
+  if (k < 1)
+    Rcpp::stop("k must be at least 1");
+
+  // as in dist_min(), the points of a geo index are only read if a
+  // starting point needs brute force
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const GeoIndex* yindex = as_geo_index(y_df);
+  const PointSet* yp = NULL;
+  if (yindex == NULL)
+    yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  int n = xp.n;
+
+  GeoTree tree;
+  const GeoTree* ytree = end_tree(yindex, yp, kind, tree);
+
+  // output columns, grown as starting points are done
+  std::vector<R_xlen_t> start, end;
+  std::vector<int> rank;
+  std::vector<double> meters;
+
+  GeoKnn knn;
+  knn.k = k;
+
+  // loop
+  for (int i = 0; i < n; i++) {
+
+    // check for interrupt
+    if(i % 1000 == 0)
+      Rcpp::checkUserInterrupt();
+
+    if (!finite_points(xp, i, i + 1))
+      continue;
+
+    knn.heap.clear();
+
+    if (ytree != NULL) {
+      geo_tree_knn(*ytree, kind, xp, i, knn);
+    } else {
+      if (yp == NULL)
+	yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+      brute_search(kind, xp, i, *yp, knn);
+    }
+
+    // closest first
+    std::sort_heap(knn.heap.begin(), knn.heap.end());
+
+    for (size_t r = 0; r < knn.heap.size(); r++) {
+      start.push_back(i);
+      rank.push_back(r + 1);
+      end.push_back(knn.heap[r].second);
+      meters.push_back(knn.heap[r].first);
+    }
+
+  }
+
+  return Rcpp::DataFrame::create(Rcpp::Named("id_start") = ids_at(idx, start),
+				 Rcpp::Named("rank") = Rcpp::wrap(rank),
+				 Rcpp::Named("id_end") = end_ids(y_df, y_id, end),
+				 Rcpp::Named("meters") = Rcpp::wrap(meters),
+				 Rcpp::Named("stringsAsFactors") = false);
+
+}
+
+//' Find all distances within a radius.
+//'
+//' Find every pair of a starting point in \strong{x} and an ending point
+//' in \strong{y} no more than \code{radius} meters apart.
+//'
+//' Ending points are searched through the same k-d tree as in
+//' \code{dist_min()}, which rules out whole groups of ending points from
+//' their bounding boxes, and pairs are collected as they are found, so the
+//' full distance matrix is never built. Points with missing coordinates
+//' are in no pairs.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()}) or loaded
+//' from a file (see \code{geo_index_load()})
+//' @param radius Distance in meters; pairs at most this far apart are
+//' returned
+//' @param x_id String name of unique identifer column in x_df
+//' @param y_id String name of unique identifer column in y_df; ignored
+//' for a geo index loaded without its data frame, which has the ids
+//' @param x_lon_col String name of column in x_df with longitude values
+//' @param x_lat_col String name of column in x_df with latitude values
+//' @param y_lon_col String name of column in y_df with longitude values
+//' @param y_lat_col String name of column in y_df with latitude values
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
+//' @return DataFrame with one row per pair: id of starting point, id of
+//' ending point and distance in meters, ordered by starting point then
+//' ending point as they appear in x_df and y_df
+//' @export
+// [[Rcpp::export]]
+Rcpp::DataFrame dist_within(SEXP x_df,
+			    SEXP y_df,
+			    double radius,
+			    std::string x_id = "id",
+			    std::string y_id = "id",
+			    std::string x_lon_col = "lon",
+			    std::string x_lat_col = "lat",
+			    std::string y_lon_col = "lon",
+			    std::string y_lat_col = "lat",
+			    std::string dist_function = "Haversine") {
+
+  // init
+  Rcpp::DataFrame xf = frame_of(x_df);
+  SEXP idx = xf[x_id];
+
+  if (!(radius >= 0))
+    Rcpp::stop("radius must be zero or more");
+
+  // as in dist_min(), the points of a geo index are only read if a
+  // starting point needs brute force
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const GeoIndex* yindex = as_geo_index(y_df);
+  const PointSet* yp = NULL;
+  if (yindex == NULL)
+    yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  int n = xp.n;
+
+  GeoTree tree;
+  const GeoTree* ytree = end_tree(yindex, yp, kind, tree);
+
+  // output columns, grown as starting points are done
+  std::vector<R_xlen_t> start, end;
+  std::vector<double> meters;
+
+  GeoWithin within;
+  within.radius = radius;
+
+  // loop
+  for (int i = 0; i < n; i++) {
+
+    // check for interrupt
+    if(i % 1000 == 0)
+      Rcpp::checkUserInterrupt();
+
+    if (!finite_points(xp, i, i + 1))
+      continue;
+
+    within.hits.clear();
+
+    if (ytree != NULL) {
+      geo_tree_within(*ytree, kind, xp, i, within);
+    } else {
+      if (yp == NULL)
+	yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+      brute_search(kind, xp, i, *yp, within);
+    }
+
+    // in order of y
+    std::sort(within.hits.begin(), within.hits.end());
+
+    for (size_t r = 0; r < within.hits.size(); r++) {
+      start.push_back(i);
+      end.push_back(within.hits[r].first);
+      meters.push_back(within.hits[r].second);
+    }
+
+  }
+
+  return Rcpp::DataFrame::create(Rcpp::Named("id_start") = ids_at(idx, start),
+				 Rcpp::Named("id_end") = end_ids(y_df, y_id, end),
+				 Rcpp::Named("meters") = Rcpp::wrap(meters),
+				 Rcpp::Named("stringsAsFactors") = false);
+
+}
+
+//' Compute distances between coordinate pairs no farther apart than
+//' max_dist (many to many) and return a sparse matrix.
+//'
+//' The \emph{n x k} matrix of \code{dist_mtom()}, keeping only the pairs
+//' within \code{max_dist}, in the compressed column form of the Matrix
+//' package's \code{dgCMatrix}: memory grows with the number of pairs kept
+//' rather than with \emph{n x k}. The starting points are put in a k-d
+//' tree, as in \code{dist_min()}, and each ending point (matrix column)
+//' searches it, so pairs too far apart are ruled out a group at a time
+//' before any distance is computed. Kept distances are the same as
+//' \code{dist_mtom()} gives for those pairs. Points with missing
+//' coordinates are in no pairs. Columns are shared out across
+//' \code{nthreads} threads.
+//'
+//' The Matrix package is not needed. To get a \code{dgCMatrix}, pass the
+//' slots to \code{Matrix::sparseMatrix(i = s$i, p = s$p, x = s$x,
+//' dims = s$Dim, index1 = FALSE)}. Pairs left out count as zero there,
+//' while pairs of identical points are kept as explicit zeros.
+//'
+//' @param xlon Vector of longitudes for starting coordinate pairs, or
+//' prepared point set (see \code{prepare_points()})
+//' @param xlat Vector of latitudes for starting coordinate pairs; ignored
+//' (use \code{NULL}) when \code{xlon} is a prepared point set
+//' @param ylon Vector of longitudes for ending coordinate pairs, or
+//' prepared point set
+//' @param ylat Vector of latitudes for ending coordinate pairs; ignored
+//' (use \code{NULL}) when \code{ylon} is a prepared point set
+//' @param max_dist Distance in meters; pairs farther apart are left out
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @return List with the slots of a \code{dgCMatrix}: 0-based row
+//' (starting point) of each kept pair \code{i}, in increasing order
+//' within each column; column start offsets into them \code{p}, of
+//' length \emph{k} + 1; distances in meters \code{x}; and dimensions
+//' \code{Dim}
+//' @export
+// [[Rcpp::export]]
+Rcpp::List dist_mtom_sparse(SEXP xlon,
+			    SEXP xlat,
+			    SEXP ylon,
+			    SEXP ylat,
+			    double max_dist,
+			    std::string dist_function = "Haversine",
+			    int nthreads = 0) {
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  if (!(max_dist >= 0))
+    Rcpp::stop("max_dist must be zero or more");
+
+  PointSet xtmp, ytmp;
+  const PointSet& xp = points_of(xlon, xlat, xtmp);
+  const PointSet& yp = points_of(ylon, ylat, ytmp);
+
+  R_xlen_t n = xp.n;
+  R_xlen_t k = yp.n;
+  int nt = resolve_threads(nthreads);
+
+  // tree over the starting points with finite coordinates; point t of
+  // the tree is row rows[t]
+  std::vector<R_xlen_t> rows;
+  std::vector<double> rlon, rlat;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (finite_points(xp, i, i + 1)) {
+      rows.push_back(i);
+      rlon.push_back(xp.lon[i]);
+      rlat.push_back(xp.lat[i]);
+    }
+  }
+
+  GeoTree tree;
+  bool use_tree = geo_tree_supports(kind) && rows.size() > GEO_LEAF;
+  if (use_tree)
+    geo_tree_build(tree, rlon.data(), rlat.data(), rows.size(),
+		   dist_is_planar(kind));
+
+  // each chunk of columns keeps its pairs in column then row order, so
+  // the chunks laid end to end give the compressed columns
+  const R_xlen_t grain = 16;
+  std::vector<std::vector<std::pair<R_xlen_t, double> > >
+    found((k + grain - 1) / grain);
+  std::vector<R_xlen_t> count(k);
+
+  parallel_for(k, grain, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+      GeoWithin within;
+      within.radius = max_dist;
+      std::vector<std::pair<R_xlen_t, double> >& out = found[lo / grain];
+
+      for (R_xlen_t j = lo; j < hi; j++) {
+
+	if (!finite_points(yp, j, j + 1))
+	  continue;
+
+	within.hits.clear();
+
+	if (use_tree) {
+	  geo_tree_within(tree, kind, yp, j, within);
+	  for (size_t h = 0; h < within.hits.size(); h++)
+	    within.hits[h].first = rows[within.hits[h].first];
+	} else {
+	  brute_search(kind, yp, j, xp, within);
+	}
+
+	std::sort(within.hits.begin(), within.hits.end());
+	out.insert(out.end(), within.hits.begin(), within.hits.end());
+	count[j] = within.hits.size();
+
+      }
+    });
+
+  // dgCMatrix slots are int
+  R_xlen_t nnz = 0;
+  for (R_xlen_t j = 0; j < k; j++)
+    nnz += count[j];
+
+  if (nnz > INT_MAX)
+    Rcpp::stop("more than 2^31 - 1 pairs are within max_dist");
+
+  Rcpp::IntegerVector ri(nnz), cp(k + 1);
+  Rcpp::NumericVector dist(nnz);
+
+  for (R_xlen_t j = 0; j < k; j++)
+    cp[j + 1] = cp[j] + count[j];
+
+  R_xlen_t q = 0;
+  for (size_t c = 0; c < found.size(); c++) {
+    for (size_t h = 0; h < found[c].size(); h++, q++) {
+      ri[q] = found[c][h].first;
+      dist[q] = found[c][h].second;
+    }
+  }
+
+  return Rcpp::List::create(Rcpp::Named("i") = ri,
+			    Rcpp::Named("p") = cp,
+			    Rcpp::Named("x") = dist,
+			    Rcpp::Named("Dim") =
+			    Rcpp::IntegerVector::create(n, k));
+
+}
+
+//' Count and sum ending points within radii.
+//'
+//' For each starting point in \strong{x}, count the ending points in
+//' \strong{y} within each of one or more radii and, given a measure
+//' column, sum and average the measure over them.
+//'
+//' All radii are handled in one search per starting point, through the
+//' same k-d tree as in \code{dist_min()}; each ending point found is
+//' added to the smallest radius that holds it, and counts and sums are
+//' then carried up to the larger radii. Pairs are not kept. Ending
+//' points with missing coordinates are not counted; starting points with
+//' missing coordinates get missing values.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()}) or loaded
+//' from a file (see \code{geo_index_load()})
+//' @param radius Numeric vector of distances in meters; ending points at
+//' most this far away are counted
+//' @param measure_col String name of measure column in y_df to sum and
+//' average, or "" (default) to count only
+//' @param x_id String name of unique identifer column in x_df
+//' @param x_lon_col String name of column in x_df with longitude values
+//' @param x_lat_col String name of column in x_df with latitude values
+//' @param y_lon_col String name of column in y_df with longitude values
+//' @param y_lat_col String name of column in y_df with latitude values
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @return DataFrame with one row per starting point and radius, ordered
+//' by starting point then radius as given: id, radius, count of ending
+//' points and, with a measure column, their sum and mean of the measure
+//' (NA where none are within the radius)
+//' @export
+// [[Rcpp::export]]
+Rcpp::DataFrame dist_within_sum(SEXP x_df,
+				SEXP y_df,
+				Rcpp::NumericVector radius,
+				std::string measure_col = "",
+				std::string x_id = "id",
+				std::string x_lon_col = "lon",
+				std::string x_lat_col = "lat",
+				std::string y_lon_col = "lon",
+				std::string y_lat_col = "lat",
+				std::string dist_function = "Haversine",
+				int nthreads = 0) {
+
+  // init
+  Rcpp::DataFrame xf = frame_of(x_df);
+  SEXP idx = xf[x_id];
+  bool has_measure = !measure_col.empty();
+  Rcpp::NumericVector meas;
+  if (has_measure) {
+    Rcpp::DataFrame yf = frame_of(y_df);
+    meas = yf[measure_col];
+  }
+
+  int nr = radius.size();
+  if (nr == 0)
+    Rcpp::stop("radius must have at least one value");
+  for (int r = 0; r < nr; r++) {
+    if (!(radius[r] >= 0))
+      Rcpp::stop("radius must be zero or more");
+  }
+
+  // radii in increasing order; a point found at distance d belongs to the
+  // first of them not below d
+  std::vector<double> bands(radius.begin(), radius.end());
+  std::sort(bands.begin(), bands.end());
+
+  // worker threads read the ending points, so an index's are read here
+  // unless its tree answers every starting point
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const GeoIndex* yindex = as_geo_index(y_df);
+  const PointSet* yp = NULL;
+  if (yindex == NULL)
+    yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // select function
+  int kind = dist_kind_of(dist_function);
+
+  int n = xp.n;
+  int nt = resolve_threads(nthreads);
+
+  GeoTree tree;
+  const GeoTree* ytree = end_tree(yindex, yp, kind, tree);
+  if (ytree == NULL && yp == NULL)
+    yp = &frame_points(y_df, y_lon_col, y_lat_col, ytmp);
+
+  // one row per starting point and radius
+  R_xlen_t rows = (R_xlen_t)n * nr;
+  Rcpp::IntegerVector count(rows);
+  Rcpp::NumericVector sum(has_measure ? rows : 0);
+  Rcpp::NumericVector mean(has_measure ? rows : 0);
+
+  // raw buffers for worker threads
+  const double* me = has_measure ? meas.begin() : NULL;
+  const double* rad = radius.begin();
+  const double* band = bands.data();
+  int* cnt = count.begin();
+  double* sm = sum.begin();
+  double* mn = mean.begin();
+
+  // each starting point is summed serially, so results do not depend on
+  // the number of threads
+  parallel_for(n, 16, nt, [&](R_xlen_t lo, R_xlen_t hi) {
+
+      GeoWithin within;
+      within.radius = band[nr - 1];
+      std::vector<R_xlen_t> bc(nr);
+      std::vector<double> bs(nr);
+
+      for (R_xlen_t i = lo; i < hi; i++) {
+
+	R_xlen_t row = i * nr;
+
+	if (!finite_points(xp, i, i + 1)) {
+	  for (int r = 0; r < nr; r++) {
+	    cnt[row + r] = NA_INTEGER;
+	    if (me != NULL)
+	      sm[row + r] = mn[row + r] = NA_REAL;
+	  }
+	  continue;
+	}
+
+	within.hits.clear();
+	if (ytree != NULL)
+	  geo_tree_within(*ytree, kind, xp, i, within);
+	else
+	  brute_search(kind, xp, i, *yp, within);
+
+	// per band, then carried up to the larger radii
+	std::fill(bc.begin(), bc.end(), 0);
+	std::fill(bs.begin(), bs.end(), 0.);
+
+	for (size_t h = 0; h < within.hits.size(); h++) {
+	  int g = std::lower_bound(band, band + nr, within.hits[h].second) - band;
+	  bc[g]++;
+	  if (me != NULL)
+	    bs[g] += me[within.hits[h].first];
+	}
+
+	for (int g = 1; g < nr; g++) {
+	  bc[g] += bc[g - 1];
+	  bs[g] += bs[g - 1];
+	}
+
+	// back in the order the radii were given
+	for (int r = 0; r < nr; r++) {
+	  int g = std::lower_bound(band, band + nr, rad[r]) - band;
+	  cnt[row + r] = bc[g];
+	  if (me != NULL) {
+	    sm[row + r] = bs[g];
+	    mn[row + r] = bc[g] > 0 ? bs[g] / bc[g] : NA_REAL;
+	  }
+	}
+
+      }
+
+    });
+
+  // ids and radii repeated for each row
+  std::vector<R_xlen_t> start(rows);
+  Rcpp::NumericVector rcol(rows);
+  for (R_xlen_t row = 0; row < rows; row++) {
+    start[row] = row / nr;
+    rcol[row] = radius[row % nr];
+  }
+
+  if (!has_measure)
+    return Rcpp::DataFrame::create(Rcpp::Named("id") = ids_at(idx, start),
+				   Rcpp::Named("radius") = rcol,
+				   Rcpp::Named("count") = count,
+				   Rcpp::Named("stringsAsFactors") = false);
+
+  return Rcpp::DataFrame::create(Rcpp::Named("id") = ids_at(idx, start),
+				 Rcpp::Named("radius") = rcol,
+				 Rcpp::Named("count") = count,
+				 Rcpp::Named("sum") = sum,
+				 Rcpp::Named("mean") = mean,
+				 Rcpp::Named("stringsAsFactors") = false);
+
+}
+
+// sum of inverse distance weights from point i of x to every point of y,
+// distances scaled by scale_units; infinite weights (coincident points)
+// count as 0. Distances are streamed FUSE_BLOCK at a time
+template <class W>
+static double inv_sum_row(int kind, const PointSet& x, R_xlen_t i,
+			  const PointSet& y, double scale_units,
+			  const W& weight) {
+
+  R_xlen_t k = y.n;
+  double d[FUSE_BLOCK];
+  double sum = 0;
+
+  for (R_xlen_t jb = 0; jb < k; jb += FUSE_BLOCK) {
+
+    R_xlen_t jend = std::min(jb + FUSE_BLOCK, k);
+
+    // distances
+    batch_prep_1tom(kind, x, i, y, jb, jend, d);
+
+    for (R_xlen_t j = 0; j < jend - jb; j++) {
+      double w = weight(d[j] / scale_units);
+      if (!std::isinf(w)) sum += w;
+    }
+  }
+
+  return sum;
+
+}
+
 //' Sum inverse distances.
 //'
 //' Find sum of inverse distances between each starting point in \strong{x}
 //' and possible end points, \strong{y}.
 //'
-//' @param x_df DataFrame with starting coordinates
-//' @param y_df DataFrame with ending coordinates
+//' With \code{tolerance} above 0 the sums are approximated as in
+//' \code{dist_weighted_mean()}, groups of ending points counting through
+//' their size, and each sum is within a relative error of
+//' \code{tolerance}.
+//'
+//' @param x_df DataFrame with starting coordinates, or prepared point set
+//' built from one (see \code{prepare_points()})
+//' @param y_df DataFrame with ending coordinates, or prepared point set
+//' or geo index built from one (see \code{geo_index_build()})
 //' @param x_id String name of unique identifer column in x_df
 //' @param y_id String name of unique identifer column in y_df
 //' @param x_lon_col String name of column in x_df with longitude values
 //' @param x_lat_col String name of column in x_df with latitude values
 //' @param y_lon_col String name of column in y_df with longitude values
 //' @param y_lat_col String name of column in y_df with latitude values
-//' @param dist_function String name of distance function: "Haversine" (default) or
-//' "Vincenty"
+//' @param dist_function String name of distance function: "Haversine" (default),
+//' "Vincenty", "Karney", "Andoyer", "Thomas", "Euclidean", "Manhattan"
+//' or "Fast"
 //' @param dist_transform String value of distance transform: "level" (default)
 //' or "log"
 //' @param decay Numeric value of distance weight decay: 2 (default)
 //' @param scale_units Double value to divide return value by (e.g., 1000 == km)
+//' @param tolerance Numeric relative error allowed; 0 (default) computes
+//' exact sums
 //' @return DataFrame with sum of distances
 //' @export
 // [[Rcpp::export]]
-Rcpp::DataFrame dist_sum_inv(Rcpp::DataFrame x_df,
-			     Rcpp::DataFrame y_df,
+Rcpp::DataFrame dist_sum_inv(SEXP x_df,
+			     SEXP y_df,
 			     std::string x_id = "id",
 			     std::string y_id = "id",
 			     std::string x_lon_col = "lon",
@@ -490,44 +2189,61 @@ Rcpp::DataFrame dist_sum_inv(Rcpp::DataFrame x_df,
 			     std::string dist_function = "Haversine",
 			     std::string dist_transform = "level",
 			     double decay = 2, 
-			     double scale_units = 1) {
+			     double scale_units = 1,
+			     double tolerance = 0) {
 
   // init
-  Rcpp::CharacterVector idx = x_df[x_id];
-  Rcpp::CharacterVector idy = y_df[y_id];
-  Rcpp::NumericVector xlon = x_df[x_lon_col];
-  Rcpp::NumericVector xlat = x_df[x_lat_col];
-  Rcpp::NumericVector ylon = y_df[y_lon_col];
-  Rcpp::NumericVector ylat = y_df[y_lat_col];
-
-  int n = xlon.size();
-  Rcpp::NumericVector dist(n);
-
-  // loop
-  for (int i = 0; i < n; i++) {
+  Rcpp::DataFrame xf = frame_of(x_df);
+  Rcpp::DataFrame yf = frame_of(y_df);
+  Rcpp::CharacterVector idx = xf[x_id];
+  Rcpp::CharacterVector idy = yf[y_id];
 
-    // check for interrupt
-    if(i % 1000 == 0)
-      Rcpp::checkUserInterrupt();
+  // every y point is paired with every x row, so prepare both once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = frame_points(x_df, x_lon_col, x_lat_col, xtmp);
+  const PointSet& yp = frame_points(y_df, y_lon_col, y_lat_col, ytmp);
 
-    // distance vector
-    Rcpp::NumericVector distvec = dist_1tom(xlon[i], xlat[i],
-					    ylon, ylat, dist_function);
+  // select function
+  int kind = dist_kind_of(dist_function);
 
-    // scale units
-    distvec = distvec / scale_units;
+  int n = xp.n;
+  Rcpp::NumericVector dist(n);
 
-    // inverse distance weights
-    Rcpp::NumericVector inv_distvec = inverse_value(distvec, decay,
-						    dist_transform);
+  bool log_transform = (dist_transform == "log");
 
-    // replace infinite values with 0
-    inv_distvec[is_infinite(inv_distvec)] = 0;
+  if (!(tolerance >= 0))
+    Rcpp::stop("tolerance must be zero or more");
 
-    // add maximum to distance output
-    dist[i] = sum(inv_distvec);
+  // groups of y are counted by size when approximating
+  GeoTree tree;
+  const GeoTree* ytree = NULL;
+  ApproxTree at;
+  std::vector<OpenNode> heap;
+  if (tolerance > 0)
+    ytree = end_tree(as_geo_index(y_df), &yp, kind, tree);
+  if (ytree != NULL)
+    approx_tree(*ytree, NULL, NULL, at);
 
-  }
+  // loop
+  WEIGHT_DISPATCH(log_transform, decay, W, weight,
+    for (int i = 0; i < n; i++) {
+
+      // check for interrupt
+      if(i % 1000 == 0)
+	Rcpp::checkUserInterrupt();
+
+      // add sum of inverse distances to output
+      if (ytree != NULL) {
+	double w_sum;
+	double unused;
+	approx_row(kind, xp, i, at, weight, log_transform, scale_units,
+		   tolerance, true, heap, &w_sum, &unused);
+	dist[i] = w_sum;
+      } else {
+	dist[i] = inv_sum_row(kind, xp, i, yp, scale_units, weight);
+      }
+
+    });
 
   return Rcpp::DataFrame::create(Rcpp::Named("id") = idx,
 				 Rcpp::Named("inv_distance") = dist,
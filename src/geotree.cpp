@@ -0,0 +1,541 @@
+// geotree.cpp
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <geotree.h>
+#include <points.h>
+#include <simd.h>
+#include <shared.h>
+#include <Rcpp.h>
+
+// whether queries with dist_kind kind can use a tree (one built planar
+// for the planar kinds)
+bool geo_tree_supports(int kind) {
+  return kind == DIST_HAVERSINE || kind == DIST_FAST ||
+    dist_on_ellipsoid(kind) || dist_is_planar(kind);
+}
+
+// position in meters on the sphere of radius a (s) and on the ellipsoid (e)
+static void positions(double lonr, double latr, double clat,
+		      double* s, double* e) {
+
+  const double e2 = f * (2. - f);
+  double slat = sin(latr);
+  double N = a / sqrt(1. - e2 * slat * slat);
+
+  s[0] = a * clat * cos(lonr);
+  s[1] = a * clat * sin(lonr);
+  s[2] = a * slat;
+
+  e[0] = N * clat * cos(lonr);
+  e[1] = N * clat * sin(lonr);
+  e[2] = N * (1. - e2) * slat;
+
+}
+
+// position of point j of p for a tree; projected points lie in the plane
+// z = 0, in both boxes
+static void point_positions(bool planar, const PointSet& p, R_xlen_t j,
+			    double* s, double* e) {
+
+  if (!planar) {
+    positions(p.lonr[j], p.latr[j], p.clat[j], s, e);
+    return;
+  }
+
+  s[0] = e[0] = p.lon[j];
+  s[1] = e[1] = p.lat[j];
+  s[2] = e[2] = 0.;
+
+}
+
+// orders point indices along one axis, ties by index
+struct AxisLess {
+
+  const double* xyz;
+  int axis;
+
+  bool operator()(R_xlen_t p, R_xlen_t q) const {
+    double u = xyz[3 * p + axis];
+    double v = xyz[3 * q + axis];
+    return u < v || (u == v && p < q);
+  }
+
+};
+
+// add node over points [lo, hi) of order and its subtree; returns its index
+static int build_node(GeoTree& t, std::vector<R_xlen_t>& order,
+		      const std::vector<double>& sph,
+		      const std::vector<double>& ell,
+		      R_xlen_t lo, R_xlen_t hi) {
+
+  GeoNode node;
+  node.lo = lo;
+  node.hi = hi;
+  node.left = -1;
+  node.right = -1;
+
+  // bounding boxes
+  for (int c = 0; c < 3; c++) {
+    node.box[c] = node.box[6 + c] = std::numeric_limits<double>::infinity();
+    node.box[3 + c] = node.box[9 + c] = -std::numeric_limits<double>::infinity();
+  }
+
+  for (R_xlen_t j = lo; j < hi; j++) {
+    const double* s = &sph[3 * order[j]];
+    const double* e = &ell[3 * order[j]];
+    for (int c = 0; c < 3; c++) {
+      node.box[c] = std::min(node.box[c], s[c]);
+      node.box[3 + c] = std::max(node.box[3 + c], s[c]);
+      node.box[6 + c] = std::min(node.box[6 + c], e[c]);
+      node.box[9 + c] = std::max(node.box[9 + c], e[c]);
+    }
+  }
+
+  int id = t.node_store.size();
+  t.node_store.push_back(node);
+
+  if (hi - lo <= GEO_LEAF)
+    return id;
+
+  // split at the median of the widest axis
+  int axis = 0;
+  for (int c = 1; c < 3; c++) {
+    if (node.box[3 + c] - node.box[c] > node.box[3 + axis] - node.box[axis])
+      axis = c;
+  }
+
+  R_xlen_t mid = lo + (hi - lo) / 2;
+  AxisLess less = { sph.data(), axis };
+  std::nth_element(order.begin() + lo, order.begin() + mid,
+		   order.begin() + hi, less);
+
+  // t.node_store may move while children are added
+  int left = build_node(t, order, sph, ell, lo, mid);
+  int right = build_node(t, order, sph, ell, mid, hi);
+  t.node_store[id].left = left;
+  t.node_store[id].right = right;
+
+  return id;
+
+}
+
+// build t over the n points (degrees, or projected if planar); all must
+// be finite
+void geo_tree_build(GeoTree& t, const double* lon, const double* lat,
+		    R_xlen_t n, bool planar) {
+
+  std::vector<double> sph(3 * n), ell(3 * n);
+  std::vector<R_xlen_t> order(n);
+
+  for (R_xlen_t j = 0; j < n; j++) {
+    if (planar) {
+      sph[3 * j] = ell[3 * j] = lon[j];
+      sph[3 * j + 1] = ell[3 * j + 1] = lat[j];
+      sph[3 * j + 2] = ell[3 * j + 2] = 0.;
+    } else {
+      double latr = deg_to_rad(lat[j]);
+      positions(deg_to_rad(lon[j]), latr, cos(latr), &sph[3 * j],
+		&ell[3 * j]);
+    }
+    order[j] = j;
+  }
+
+  t.node_store.clear();
+  if (n > 0)
+    build_node(t, order, sph, ell, 0, n);
+
+  // points in tree order, so each leaf is one run for the batch kernels
+  std::vector<double> tlon(n), tlat(n);
+  for (R_xlen_t j = 0; j < n; j++) {
+    tlon[j] = lon[order[j]];
+    tlat[j] = lat[order[j]];
+  }
+
+  prepare_into(t.pts, tlon.data(), tlat.data(), n);
+  t.perm_store.swap(order);
+  t.planar = planar;
+
+  t.perm = t.perm_store.data();
+  t.nodes = t.node_store.data();
+  t.n_nodes = t.node_store.size();
+
+}
+
+// lower bound on the dist_kind kind distance from q to points in node
+static double node_bound(const GeoNode& node, int kind, const double* q) {
+
+  bool ell = dist_on_ellipsoid(kind);
+  const double* lo = node.box + (ell ? 6 : 0);
+  const double* hi = lo + 3;
+
+  double c1 = 0, c2 = 0;
+  for (int c = 0; c < 3; c++) {
+    double g = std::max(0., std::max(lo[c] - q[c], q[c] - hi[c]));
+    c1 += g;
+    c2 += g * g;
+  }
+
+  if (kind == DIST_MANHATTAN)
+    return c1;
+
+  double chord = sqrt(c2);
+
+  // geodesics are no shorter than chords; on the sphere the arc is
+  // known exactly from the chord
+  if (ell || kind == DIST_EUCLIDEAN)
+    return chord;
+  else
+    return 2. * a * asin(std::min(1., chord / (2. * a)));
+
+}
+
+// upper bound on the chord from q to points in the sphere box of node,
+// or on the city-block distance if manhattan
+static double node_far_chord(const GeoNode& node, const double* q,
+			     bool manhattan) {
+
+  double c1 = 0, c2 = 0;
+  for (int c = 0; c < 3; c++) {
+    double g = std::max(std::fabs(q[c] - node.box[c]),
+			std::fabs(node.box[3 + c] - q[c]));
+    c1 += g;
+    c2 += g * g;
+  }
+
+  return manhattan ? c1 : sqrt(c2);
+
+}
+
+// position of point i of x for geo_node_range(): on the sphere, then on
+// the ellipsoid, or twice in the plane for planar kinds
+void geo_tree_query(int kind, const PointSet& x, R_xlen_t i, double* q) {
+  point_positions(dist_is_planar(kind), x, i, q, q + 3);
+}
+
+// Range [*lo, *hi] holding the distance from query q to every point in
+// node. Haversine distances follow from chords on the sphere. Geodesics
+// are no shorter than ellipsoid chords, and the ellipsoid's radii of
+// curvature lie between a (1 - e2) and a / sqrt(1 - e2), so every path,
+// and hence the geodesic, is within those factors of the Haversine
+// distance between the same coordinates. Fast distances are at least the
+// Haversine distance and at most FAST_MAX_ERROR more. Planar distances
+// come straight from the box.
+void geo_node_range(const GeoNode& node, int kind, const double* q,
+		    double* lo, double* hi) {
+
+  const double e2 = f * (2. - f);
+
+  double near, far;
+
+  if (dist_is_planar(kind)) {
+    near = node_bound(node, kind, q);
+    far = node_far_chord(node, q, kind == DIST_MANHATTAN);
+  } else {
+    near = node_bound(node, DIST_HAVERSINE, q);
+    double chord = node_far_chord(node, q, false);
+    far = 2. * a * asin(std::min(1., chord / (2. * a)));
+    if (kind == DIST_FAST)
+      far += FAST_MAX_ERROR;
+  }
+
+  if (dist_on_ellipsoid(kind)) {
+    near = std::max(node_bound(node, kind, q + 3), (1. - e2) * near);
+    far = far / sqrt(1. - e2);
+  }
+
+  *lo = std::max(0., near - (GEO_REL_SLACK * near + GEO_ABS_SLACK));
+  *hi = far + (GEO_REL_SLACK * far + GEO_ABS_SLACK);
+
+}
+
+static inline bool ruled_out(double bound, double best) {
+  return bound - (GEO_REL_SLACK * bound + GEO_ABS_SLACK) > best;
+}
+
+// Depth-first search of t from point i of x. acc.worst() is the distance
+// beyond which acc has no use for points; leaves it cannot rule out are
+// handed to acc.add(d, j) one point at a time, with input index j.
+template <class Acc>
+static void tree_search(const GeoTree& t, int kind, const PointSet& x,
+			R_xlen_t i, Acc& acc) {
+
+  bool ell = dist_on_ellipsoid(kind);
+  const double e2 = f * (2. - f);
+
+  double s[3], e[3];
+  point_positions(dist_is_planar(kind), x, i, s, e);
+  const double* q = ell ? e : s;
+
+  double d[GEO_LEAF];
+  R_xlen_t keep[GEO_LEAF];
+
+  // nearer child first; the tree is balanced, so the stack never holds
+  // more than one node per level plus one
+  int stack[GEO_MAX_DEPTH + 2];
+  double bound[GEO_MAX_DEPTH + 2];
+  int top = 0;
+
+  if (t.n_nodes > 0) {
+    stack[0] = 0;
+    bound[0] = node_bound(t.nodes[0], kind, q);
+    top = 1;
+  }
+
+  while (top > 0) {
+
+    top--;
+    if (ruled_out(bound[top], acc.worst()))
+      continue;
+
+    const GeoNode& node = t.nodes[stack[top]];
+
+    if (node.left < 0 && ell) {
+
+      // Haversine distances first: geodesics are at least (1 - e2) times
+      // as long (see geo_node_range()), so the iterative solver runs only
+      // on points that could still be wanted
+      batch_prep_1tom(DIST_HAVERSINE, x, i, t.pts, node.lo, node.hi, d);
+
+      int m = 0;
+      for (R_xlen_t j = node.lo; j < node.hi; j++) {
+	if (!ruled_out((1. - e2) * d[j - node.lo], acc.worst()))
+	  keep[m++] = j;
+      }
+
+      // most of the leaf is wanted: one batch is faster
+      if (2 * m > node.hi - node.lo) {
+	batch_prep_1tom(kind, x, i, t.pts, node.lo, node.hi, d);
+	for (int r = 0; r < m; r++)
+	  acc.add(d[keep[r] - node.lo], t.perm[keep[r]]);
+	continue;
+      }
+
+      for (int r = 0; r < m; r++) {
+	if (ruled_out((1. - e2) * d[keep[r] - node.lo], acc.worst()))
+	  continue;
+	double v;
+	batch_prep_1tom(kind, x, i, t.pts, keep[r], keep[r] + 1, &v);
+	acc.add(v, t.perm[keep[r]]);
+      }
+
+      continue;
+
+    }
+
+    if (node.left < 0) {
+
+      // exact distances for the leaf
+      batch_prep_1tom(kind, x, i, t.pts, node.lo, node.hi, d);
+
+      for (R_xlen_t j = node.lo; j < node.hi; j++)
+	acc.add(d[j - node.lo], t.perm[j]);
+
+      continue;
+
+    }
+
+    double bl = node_bound(t.nodes[node.left], kind, q);
+    double br = node_bound(t.nodes[node.right], kind, q);
+
+    // push the farther child first so the nearer one is searched first
+    if (bl <= br) {
+      stack[top] = node.right; bound[top++] = br;
+      stack[top] = node.left; bound[top++] = bl;
+    } else {
+      stack[top] = node.left; bound[top++] = bl;
+      stack[top] = node.right; bound[top++] = br;
+    }
+
+  }
+
+}
+
+// nearest point seen so far, ties to the lowest index
+struct NearestAcc {
+
+  double best;
+  R_xlen_t best_j;
+
+  double worst() const { return best; }
+
+  void add(double d, R_xlen_t j) {
+    if (d < best || (d == best && j < best_j)) {
+      best = d;
+      best_j = j;
+    }
+  }
+
+};
+
+// input index of the point of t nearest point i of x, with its distance
+// in *dist; ties go to the lowest index, as with which_min()
+R_xlen_t geo_tree_nearest(const GeoTree& t, int kind,
+			  const PointSet& x, R_xlen_t i, double* dist) {
+
+  NearestAcc acc = { std::numeric_limits<double>::infinity(), -1 };
+  tree_search(t, kind, x, i, acc);
+
+  *dist = acc.best;
+  return acc.best_j;
+
+}
+
+// k nearest points of t to point i of x, into knn
+void geo_tree_knn(const GeoTree& t, int kind, const PointSet& x,
+		  R_xlen_t i, GeoKnn& knn) {
+  tree_search(t, kind, x, i, knn);
+}
+
+// points of t within within.radius of point i of x, added to within
+void geo_tree_within(const GeoTree& t, int kind, const PointSet& x,
+		     R_xlen_t i, GeoWithin& within) {
+  tree_search(t, kind, x, i, within);
+}
+
+// index behind an external pointer; NULL if x is not one
+const GeoIndex* as_geo_index(SEXP x) {
+
+  if (TYPEOF(x) != EXTPTRSXP || !Rf_inherits(x, "distRcpp_geo_index"))
+    return NULL;
+
+  Rcpp::XPtr<GeoIndex> ptr(x);
+
+  // external pointers do not survive saving and reloading
+  if (ptr.get() == NULL)
+    Rcpp::stop("geo index is no longer valid; build it again");
+
+  return ptr.get();
+
+}
+
+// ids of points rows of g (input order); negative rows give NA
+Rcpp::CharacterVector geo_index_ids(const GeoIndex& g,
+				    const std::vector<R_xlen_t>& rows) {
+
+  R_xlen_t m = rows.size();
+  Rcpp::CharacterVector out(m);
+
+  for (R_xlen_t r = 0; r < m; r++) {
+    R_xlen_t j = rows[r];
+    if (j < 0 || g.id_na[j]) {
+      out[r] = NA_STRING;
+    } else {
+      std::string id(g.id_bytes + g.id_off[j], g.id_off[j + 1] - g.id_off[j]);
+      out[r] = Rcpp::String(id, CE_UTF8);
+    }
+  }
+
+  return out;
+
+}
+
+// fill p with the points of t in their input order
+void geo_tree_points(const GeoTree& t, PointSet& p) {
+
+  R_xlen_t n = t.pts.n;
+  std::vector<double> lon(n), lat(n);
+
+  for (R_xlen_t j = 0; j < n; j++) {
+    lon[t.perm[j]] = t.pts.lon[j];
+    lat[t.perm[j]] = t.pts.lat[j];
+  }
+
+  prepare_into(p, lon.data(), lat.data(), n);
+
+}
+
+//' Build spatial index over ending points.
+//'
+//' Builds the k-d tree that \code{dist_min()} searches (see there) once,
+//' for ending points that are queried many times. The returned index can
+//' be passed in place of \code{y_df} (or \code{x_df}) to
+//' \code{dist_min()}, \code{dist_max()}, \code{dist_sum_inv()},
+//' \code{dist_weighted_mean()} and \code{popdist_weighted_mean()}; the
+//' coordinate column arguments are then ignored and other columns (ids,
+//' measures, population) are read from \code{y_df}. \code{dist_min()}
+//' searches the stored tree directly. Indexes do not survive saving and
+//' reloading a session; write them to a file with \code{geo_index_save()}
+//' instead.
+//'
+//' An index over projected coordinates (\code{projected = TRUE}) is for
+//' the "Euclidean" and "Manhattan" distance functions only, and an index
+//' over longitude and latitude for the others.
+//'
+//' @param y_df DataFrame with coordinates of ending points; coordinates
+//' must be finite
+//' @param lon_col String name of column in y_df with longitude (or x)
+//' values
+//' @param lat_col String name of column in y_df with latitude (or y)
+//' values
+//' @param projected Logical, whether coordinates are projected rather
+//' than longitude and latitude
+//' @return External pointer of class \code{distRcpp_geo_index}
+//' @export
+// [[Rcpp::export]]
+SEXP geo_index_build(Rcpp::DataFrame y_df,
+		     std::string lon_col = "lon",
+		     std::string lat_col = "lat",
+		     bool projected = false) {
+
+  Rcpp::NumericVector lon = y_df[lon_col];
+  Rcpp::NumericVector lat = y_df[lat_col];
+
+  for (R_xlen_t j = 0; j < lon.size(); j++) {
+    if (!std::isfinite(lon[j]) || !std::isfinite(lat[j]))
+      Rcpp::stop("coordinates must be finite to build a geo index");
+  }
+
+  // owned by R from here on; the data frame is kept alive alongside for
+  // its other columns
+  Rcpp::XPtr<GeoIndex> ptr(new GeoIndex, true, R_NilValue, y_df);
+  ptr.attr("class") = "distRcpp_geo_index";
+
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  geo_tree_build(ptr->tree, lon.begin(), lat.begin(), lon.size(),
+		 projected);
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+  ptr->build_seconds = std::chrono::duration<double>(t1 - t0).count();
+
+  return ptr;
+
+}
+
+//' Describe spatial index.
+//'
+//' @param index Index from \code{geo_index_build()} or
+//' \code{geo_index_load()}
+//' @return List with number of points, number of tree nodes, memory held
+//' by the index in bytes (not counting the data frame it was built from),
+//' time in seconds the tree took to build, whether the index is a file
+//' mapped into memory, and whether it is over projected coordinates
+//' @export
+// [[Rcpp::export]]
+Rcpp::List geo_index_info(SEXP index) {
+
+  const GeoIndex* g = as_geo_index(index);
+
+  if (g == NULL)
+    Rcpp::stop("index is not a geo index; see geo_index_build()");
+
+  // a mapped file counts in full, though its pages are shared between
+  // processes and only read in as queries touch them
+  const GeoTree& t = g->tree;
+  double bytes = sizeof(GeoIndex) + g->map_bytes +
+    t.pts.store.capacity() * sizeof(double) +
+    t.perm_store.capacity() * sizeof(R_xlen_t) +
+    t.node_store.capacity() * sizeof(GeoNode) +
+    g->file_store.capacity() * sizeof(double);
+
+  return Rcpp::List::create(Rcpp::Named("points") = (double)t.pts.n,
+			    Rcpp::Named("nodes") = (double)t.n_nodes,
+			    Rcpp::Named("bytes") = bytes,
+			    Rcpp::Named("build_seconds") = g->build_seconds,
+			    Rcpp::Named("mapped") = (g->map != NULL),
+			    Rcpp::Named("projected") = t.planar);
+
+}
@@ -0,0 +1,436 @@
+// geotree_io.cpp
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DISTRCPP_MMAP 1
+#endif
+#include <geotree.h>
+#include <points.h>
+#include <shared.h>
+#include <Rcpp.h>
+
+// Geo index file: a fixed header, then sections each starting at a
+// multiple of GEO_FILE_ALIGN bytes, so a file mapped into memory is read
+// in place with no parsing:
+//   points    POINT_COLUMNS columns of n doubles in tree order, as in a
+//             PointSet
+//   perm      n R_xlen_t, input index of each point
+//   nodes     n_nodes GeoNode
+//   id_off    n + 1 uint64_t, start of each id in id_bytes
+//   id_bytes  ids as UTF-8, not terminated
+//   id_na     n bytes, 1 where the id is NA
+// Values are written as they are held in memory. The header records what
+// that depends on (byte order, sizes of the stored types, points per
+// leaf), and a file written under a different layout is refused rather
+// than converted. GEO_FILE_VERSION goes up whenever the layout changes.
+
+#define GEO_FILE_MAGIC "DRCPGIX"
+#define GEO_FILE_VERSION 2
+#define GEO_FILE_ALIGN 64
+#define GEO_FILE_ENDIAN 0x0102030405060708ULL
+
+enum geo_section {
+  GEO_SEC_POINTS, GEO_SEC_PERM, GEO_SEC_NODES,
+  GEO_SEC_ID_OFF, GEO_SEC_ID_BYTES, GEO_SEC_ID_NA,
+  GEO_SECTIONS
+};
+
+// all fields are 8 bytes wide, so the struct has no padding
+struct GeoFileHeader {
+
+  char magic[8];
+  uint64_t version;
+  uint64_t endian;
+  uint64_t n;
+  uint64_t n_nodes;
+  uint64_t leaf;
+  uint64_t columns;
+  uint64_t node_bytes;
+  uint64_t index_bytes;
+  uint64_t planar;
+  double build_seconds;
+  uint64_t off[GEO_SECTIONS];
+  uint64_t size[GEO_SECTIONS];
+  uint64_t file_bytes;
+
+};
+
+static uint64_t align_up(uint64_t x) {
+  return (x + GEO_FILE_ALIGN - 1) / GEO_FILE_ALIGN * GEO_FILE_ALIGN;
+}
+
+// release the file behind a loaded index
+GeoIndex::~GeoIndex() {
+#ifdef DISTRCPP_MMAP
+  if (map != NULL)
+    munmap(const_cast<void*>(map), map_bytes);
+#endif
+}
+
+// write bytes to fp, then zeros up to the next section
+static bool write_section(std::FILE* fp, const void* p, uint64_t bytes,
+			  uint64_t* pos) {
+
+  static const char zeros[GEO_FILE_ALIGN] = { 0 };
+
+  if (bytes > 0 && std::fwrite(p, 1, bytes, fp) != bytes)
+    return false;
+
+  uint64_t pad = align_up(*pos + bytes) - (*pos + bytes);
+  if (pad > 0 && std::fwrite(zeros, 1, pad, fp) != pad)
+    return false;
+
+  *pos += bytes + pad;
+  return true;
+
+}
+
+//' Save spatial index to a file.
+//'
+//' Writes an index from \code{geo_index_build()} to a binary file that
+//' \code{geo_index_load()} maps into memory, so the tree over a large set
+//' of ending points is built once rather than in every session. The file
+//' holds the tree, the prepared coordinates and the ids of the points;
+//' other columns stay in the data frame. The file is written next to
+//' \code{path} and then renamed over it, so processes that have an older
+//' version of the file loaded keep reading that version.
+//'
+//' Files store numbers as they are held in memory and can only be loaded
+//' on machines with the same byte order and word size.
+//'
+//' @param index Index from \code{geo_index_build()} or
+//' \code{geo_index_load()}
+//' @param path String path of file to write
+//' @param id_col String name of unique identifer column in the data frame
+//' the index was built from
+//' @return \code{path}
+//' @export
+// [[Rcpp::export]]
+SEXP geo_index_save(SEXP index,
+		    std::string path,
+		    std::string id_col = "id") {
+
+  const GeoIndex* g = as_geo_index(index);
+
+  if (g == NULL)
+    Rcpp::stop("index is not a geo index; see geo_index_build()");
+
+  const GeoTree& t = g->tree;
+  R_xlen_t n = t.pts.n;
+
+  // ids from the data frame, or the ones an index loaded without one
+  // brought along
+  std::vector<uint64_t> off_store;
+  std::vector<char> bytes_store;
+  std::vector<unsigned char> na_store;
+  const uint64_t* id_off = g->id_off;
+  const char* id_bytes = g->id_bytes;
+  const unsigned char* id_na = g->id_na;
+
+  if (TYPEOF(R_ExternalPtrProtected(index)) == VECSXP) {
+
+    Rcpp::DataFrame df = frame_of(index);
+    Rcpp::CharacterVector ids = df[id_col];
+
+    if (ids.size() != n)
+      Rcpp::stop("id column does not match the points of the index");
+
+    off_store.assign(n + 1, 0);
+    na_store.assign(n, 0);
+
+    for (R_xlen_t j = 0; j < n; j++) {
+      if (Rcpp::CharacterVector::is_na(ids[j])) {
+	na_store[j] = 1;
+      } else {
+	const char* s = Rf_translateCharUTF8(STRING_ELT(ids, j));
+	bytes_store.insert(bytes_store.end(), s, s + std::strlen(s));
+      }
+      off_store[j + 1] = bytes_store.size();
+    }
+
+    id_off = off_store.data();
+    id_bytes = bytes_store.data();
+    id_na = na_store.data();
+
+  } else if (id_off == NULL) {
+    Rcpp::stop("geo index has no ids; build it from a data frame");
+  }
+
+  // layout
+  GeoFileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, GEO_FILE_MAGIC, sizeof(GEO_FILE_MAGIC));
+  h.version = GEO_FILE_VERSION;
+  h.endian = GEO_FILE_ENDIAN;
+  h.n = n;
+  h.n_nodes = t.n_nodes;
+  h.leaf = GEO_LEAF;
+  h.columns = POINT_COLUMNS;
+  h.node_bytes = sizeof(GeoNode);
+  h.index_bytes = sizeof(R_xlen_t);
+  h.planar = t.planar;
+  h.build_seconds = g->build_seconds;
+
+  h.size[GEO_SEC_POINTS] = (uint64_t)n * POINT_COLUMNS * sizeof(double);
+  h.size[GEO_SEC_PERM] = (uint64_t)n * sizeof(R_xlen_t);
+  h.size[GEO_SEC_NODES] = (uint64_t)t.n_nodes * sizeof(GeoNode);
+  h.size[GEO_SEC_ID_OFF] = ((uint64_t)n + 1) * sizeof(uint64_t);
+  h.size[GEO_SEC_ID_BYTES] = id_off[n];
+  h.size[GEO_SEC_ID_NA] = n;
+
+  uint64_t pos = align_up(sizeof(h));
+  for (int s = 0; s < GEO_SECTIONS; s++) {
+    h.off[s] = pos;
+    pos = align_up(pos + h.size[s]);
+  }
+  h.file_bytes = pos;
+
+  // write under a temporary name, then rename over path
+  std::string tmp = path + ".tmp";
+  std::FILE* fp = std::fopen(tmp.c_str(), "wb");
+
+  if (fp == NULL)
+    Rcpp::stop("cannot open " + tmp + " for writing");
+
+  const double* cols[POINT_COLUMNS] = {
+    t.pts.lon, t.pts.lat, t.pts.lonr, t.pts.latr, t.pts.clat,
+    t.pts.shlat, t.pts.chlat, t.pts.shlon, t.pts.chlon, t.pts.sU, t.pts.cU
+  };
+
+  uint64_t at = 0;
+  bool ok = write_section(fp, &h, sizeof(h), &at);
+  for (int c = 0; ok && c < POINT_COLUMNS; c++) {
+    // columns are contiguous; pad only after the last one
+    if (c < POINT_COLUMNS - 1) {
+      uint64_t bytes = n * sizeof(double);
+      ok = n == 0 || std::fwrite(cols[c], 1, bytes, fp) == bytes;
+      at += bytes;
+    } else {
+      ok = write_section(fp, cols[c], n * sizeof(double), &at);
+    }
+  }
+  ok = ok && write_section(fp, t.perm, h.size[GEO_SEC_PERM], &at);
+  ok = ok && write_section(fp, t.nodes, h.size[GEO_SEC_NODES], &at);
+  ok = ok && write_section(fp, id_off, h.size[GEO_SEC_ID_OFF], &at);
+  ok = ok && write_section(fp, id_bytes, h.size[GEO_SEC_ID_BYTES], &at);
+  ok = ok && write_section(fp, id_na, h.size[GEO_SEC_ID_NA], &at);
+  ok = (std::fclose(fp) == 0) && ok && at == h.file_bytes;
+
+#ifdef _WIN32
+  // rename() does not replace an existing file here
+  if (ok)
+    std::remove(path.c_str());
+#endif
+
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    Rcpp::stop("cannot write geo index to " + path);
+  }
+
+  return Rcpp::wrap(path);
+
+}
+
+// check header h of a file of file_bytes bytes; stops if it cannot be read
+static void check_header(const GeoFileHeader& h, uint64_t file_bytes,
+			 const std::string& path) {
+
+  if (std::memcmp(h.magic, GEO_FILE_MAGIC, sizeof(GEO_FILE_MAGIC)) != 0)
+    Rcpp::stop(path + " is not a geo index file");
+
+  if (h.version != GEO_FILE_VERSION)
+    Rcpp::stop(path + " has geo index file version " +
+	       std::to_string(h.version) + "; this version of distRcpp reads " +
+	       std::to_string(GEO_FILE_VERSION) + ", so build the index again");
+
+  if (h.endian != GEO_FILE_ENDIAN || h.leaf != GEO_LEAF ||
+      h.columns != POINT_COLUMNS || h.node_bytes != sizeof(GeoNode) ||
+      h.index_bytes != sizeof(R_xlen_t))
+    Rcpp::stop(path + " was written on a machine with a different layout; "
+	       "build the index again");
+
+  // sections must be where the counts put them and inside the file
+  uint64_t n = h.n;
+  uint64_t size[GEO_SECTIONS] = {
+    n * POINT_COLUMNS * sizeof(double), n * sizeof(R_xlen_t),
+    h.n_nodes * sizeof(GeoNode), (n + 1) * sizeof(uint64_t),
+    h.size[GEO_SEC_ID_BYTES], n
+  };
+
+  bool ok = h.file_bytes == file_bytes && (n == 0) == (h.n_nodes == 0);
+  for (int s = 0; ok && s < GEO_SECTIONS; s++) {
+    ok = h.size[s] == size[s] && h.off[s] % GEO_FILE_ALIGN == 0 &&
+      h.off[s] >= sizeof(h) && h.off[s] <= file_bytes &&
+      size[s] <= file_bytes - h.off[s];
+  }
+
+  if (!ok)
+    Rcpp::stop(path + " is truncated or damaged");
+
+}
+
+// Check the indices a loaded index is read through, so a damaged file
+// whose header adds up is refused rather than read out of bounds: perm
+// a permutation of the points, each node's range within its parent's and leaves no
+// larger than GEO_LEAF, children after their parent and no deeper than
+// the search stack in tree_search() allows, and id_off non-decreasing.
+static bool check_arrays(const GeoIndex& g, R_xlen_t n) {
+
+  const GeoTree& t = g.tree;
+
+  std::vector<bool> seen(n, false);
+  for (R_xlen_t j = 0; j < n; j++) {
+    if (t.perm[j] < 0 || t.perm[j] >= n || seen[t.perm[j]])
+      return false;
+    seen[t.perm[j]] = true;
+  }
+
+  if (t.n_nodes > 0 && (t.nodes[0].lo != 0 || t.nodes[0].hi != n))
+    return false;
+
+  std::vector<int> depth(t.n_nodes, 0);
+  for (R_xlen_t k = 0; k < t.n_nodes; k++) {
+    const GeoNode& node = t.nodes[k];
+    if (node.lo < 0 || node.lo > node.hi || node.hi > n)
+      return false;
+    if (node.left < 0) {
+      if (node.right >= 0 || node.hi - node.lo > GEO_LEAF)
+	return false;
+      continue;
+    }
+    if (node.left <= k || node.left >= t.n_nodes ||
+	node.right <= k || node.right >= t.n_nodes || depth[k] >= GEO_MAX_DEPTH)
+      return false;
+    const GeoNode& l = t.nodes[node.left];
+    const GeoNode& r = t.nodes[node.right];
+    if (l.lo != node.lo || l.hi != r.lo || r.hi != node.hi)
+      return false;
+    depth[node.left] = depth[node.right] = depth[k] + 1;
+  }
+
+  for (R_xlen_t j = 0; j < n; j++) {
+    if (g.id_off[j] > g.id_off[j + 1])
+      return false;
+  }
+
+  return true;
+
+}
+
+//' Load spatial index from a file.
+//'
+//' Maps a file written by \code{geo_index_save()} into memory read only.
+//' Nothing is built or copied. The tree, its point order and the id
+//' offsets (about 24 bytes a point) are read once to check that the file
+//' is not damaged: for a million points this takes about 6 ms when the
+//' file is already in memory and 60 ms when it comes from disk. The
+//' coordinates and ids are read from disk as queries first touch them.
+//' Processes on one machine that load the same file share its pages in
+//' memory. On Windows the file is read into memory instead.
+//'
+//' The index can be passed in place of \code{y_df} as one from
+//' \code{geo_index_build()} can. Without \code{y_df}, \code{dist_min()}
+//' and \code{dist_max()} name ending points with the ids saved in the
+//' file (\code{y_id} is then ignored); functions that need other columns
+//' need \code{y_df}.
+//'
+//' @param path String path of file written by \code{geo_index_save()}
+//' @param y_df Optional DataFrame the index was built from, for columns
+//' other than coordinates and ids; rows must be in the same order
+//' @return External pointer of class \code{distRcpp_geo_index}
+//' @export
+// [[Rcpp::export]]
+SEXP geo_index_load(std::string path,
+		    SEXP y_df = R_NilValue) {
+
+  Rcpp::XPtr<GeoIndex> ptr(new GeoIndex, true, R_NilValue, y_df);
+  ptr.attr("class") = "distRcpp_geo_index";
+  GeoIndex& g = *ptr;
+
+  GeoFileHeader h;
+  const char* base = NULL;
+  uint64_t file_bytes = 0;
+
+#ifdef DISTRCPP_MMAP
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    Rcpp::stop("cannot open " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(h)) {
+    close(fd);
+    Rcpp::stop(path + " is not a geo index file");
+  }
+
+  // the mapping stays valid after the descriptor is closed
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    Rcpp::stop("cannot map " + path + " into memory");
+
+  g.map = map;
+  g.map_bytes = st.st_size;
+  file_bytes = st.st_size;
+  base = static_cast<const char*>(map);
+
+#else
+
+  std::FILE* fp = std::fopen(path.c_str(), "rb");
+  if (fp == NULL)
+    Rcpp::stop("cannot open " + path);
+
+  std::fseek(fp, 0, SEEK_END);
+  long bytes = std::ftell(fp);
+  std::fseek(fp, 0, SEEK_SET);
+
+  // doubles keep the sections aligned
+  g.file_store.resize((bytes + sizeof(double) - 1) / sizeof(double));
+  bool ok = bytes >= (long)sizeof(h) &&
+    std::fread(g.file_store.data(), 1, bytes, fp) == (size_t)bytes;
+  std::fclose(fp);
+
+  if (!ok)
+    Rcpp::stop(path + " is not a geo index file");
+
+  base = reinterpret_cast<const char*>(g.file_store.data());
+  file_bytes = bytes;
+
+#endif
+
+  std::memcpy(&h, base, sizeof(h));
+  check_header(h, file_bytes, path);
+
+  R_xlen_t n = h.n;
+
+  if (!Rf_isNull(y_df)) {
+    Rcpp::DataFrame df(y_df);
+    if (df.nrows() != n)
+      Rcpp::stop("y_df does not have one row per point of the index");
+  }
+
+  GeoTree& t = g.tree;
+  point_columns(t.pts, (const double*)(base + h.off[GEO_SEC_POINTS]), n);
+  t.perm = (const R_xlen_t*)(base + h.off[GEO_SEC_PERM]);
+  t.nodes = (const GeoNode*)(base + h.off[GEO_SEC_NODES]);
+  t.n_nodes = h.n_nodes;
+  t.planar = (h.planar != 0);
+
+  g.id_off = (const uint64_t*)(base + h.off[GEO_SEC_ID_OFF]);
+  g.id_bytes = base + h.off[GEO_SEC_ID_BYTES];
+  g.id_na = (const unsigned char*)(base + h.off[GEO_SEC_ID_NA]);
+  g.build_seconds = h.build_seconds;
+
+  if (g.id_off[n] != h.size[GEO_SEC_ID_BYTES] || !check_arrays(g, n))
+    Rcpp::stop(path + " is truncated or damaged");
+
+  return ptr;
+
+}
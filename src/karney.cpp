@@ -0,0 +1,638 @@
+// karney.cpp
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <shared.h>
+#include <Rcpp.h>
+
+// Inverse geodesic problem on the WGS84 ellipsoid after C. F. F. Karney,
+// "Algorithms for geodesics", J. Geodesy 87 (2013), following the layout
+// of his GeographicLib (MIT licence), distance only. The series in the
+// third flattening n are carried to order 6, so distances are accurate to
+// about 15 nanometers. Newton's method on the azimuth at the starting
+// point is kept inside a bracket of the root and falls back to bisection,
+// and nearly antipodal points start from the solution of the astroid
+// problem, so the solution always converges.
+
+// series orders and scratch size
+#define KARNEY_ORD 6
+#define KARNEY_NC (KARNEY_ORD + 1)
+#define KARNEY_NC3X ((KARNEY_ORD * (KARNEY_ORD - 1)) / 2)
+
+// iterations of Newton's method, then of bisection
+#define KARNEY_MAXIT1 20
+#define KARNEY_MAXIT2 (KARNEY_MAXIT1 + DBL_MANT_DIG + 10)
+
+static const double kn_f = (f);
+static const double kn_f1 = 1. - (f);
+static const double kn_e2 = (f) * (2. - (f));
+static const double kn_ep2 = kn_e2 / (kn_f1 * kn_f1);
+static const double kn_n = (f) / (2. - (f));
+static const double kn_b = (b);
+
+static const double tiny = sqrt(DBL_MIN);
+static const double tol0 = DBL_EPSILON;
+static const double tol1 = 200 * tol0;
+static const double tol2 = sqrt(tol0);
+static const double tolb = tol0 * tol2;
+static const double xthresh = 1000 * tol2;
+static const double etol2 = 0.1 * tol2 /
+  sqrt(std::max(0.001, fabs(kn_f)) * std::min(1., 1. - kn_f / 2.) / 2.);
+
+static inline double sq(double x) { return x * x; }
+
+// p[0] x^N + p[1] x^(N-1) + ... + p[N]
+static double polyval(int N, const double* p, double x) {
+  double y = N < 0 ? 0 : *p++;
+  while (--N >= 0) y = y * x + *p++;
+  return y;
+}
+
+// coefficients of A3 and C3 as polynomials in eps, fixed by n
+struct KarneyCoeff {
+
+  double A3x[KARNEY_ORD];
+  double C3x[KARNEY_NC3X];
+
+  KarneyCoeff() {
+
+    static const double A3[] = {
+      -3, 128,
+      -2, -3, 64,
+      -1, -3, -1, 16,
+      3, -1, -2, 8,
+      1, -1, 2,
+      1, 1,
+    };
+
+    static const double C3[] = {
+      3, 128,
+      2, 5, 128,
+      -1, 3, 3, 64,
+      -1, 0, 1, 8,
+      -1, 1, 4,
+      5, 256,
+      1, 3, 128,
+      -3, -2, 3, 64,
+      1, -3, 2, 32,
+      7, 512,
+      -10, 9, 384,
+      5, -9, 5, 192,
+      7, 512,
+      -14, 7, 512,
+      21, 2560,
+    };
+
+    int o = 0, k = 0;
+    for (int j = KARNEY_ORD - 1; j >= 0; j--) {
+      int m = std::min(KARNEY_ORD - j - 1, j);
+      A3x[k++] = polyval(m, A3 + o, kn_n) / A3[o + m + 1];
+      o += m + 2;
+    }
+
+    o = 0; k = 0;
+    for (int l = 1; l < KARNEY_ORD; l++) {
+      for (int j = KARNEY_ORD - 1; j >= l; j--) {
+	int m = std::min(KARNEY_ORD - j - 1, j);
+	C3x[k++] = polyval(m, C3 + o, kn_n) / C3[o + m + 1];
+	o += m + 2;
+      }
+    }
+
+  }
+
+};
+
+static const KarneyCoeff coeff;
+
+static inline void norm2(double* s, double* c) {
+  double r = hypot(*s, *c);
+  *s /= r;
+  *c /= r;
+}
+
+// error-free sum: returns u + v with the rounding error in *t
+static inline double sumx(double u, double v, double* t) {
+  volatile double s = u + v;
+  volatile double up = s - v;
+  volatile double vpp = s - up;
+  up -= u;
+  vpp -= v;
+  *t = s != 0 ? 0. - (up + vpp) : s;
+  return s;
+}
+
+// x with tiny values coarsened to the resolution of 1/16, so that points
+// very near the equator are treated as on it
+static inline double ang_round(double x) {
+  const double z = 1. / 16.;
+  volatile double y = fabs(x);
+  volatile double w = z - y;
+  y = w > 0 ? z - w : y;
+  return copysign(y, x);
+}
+
+// y - x in (-180, 180], with its rounding error in *e
+static double ang_diff(double x, double y, double* e) {
+  double t, d = sumx(remainder(-x, 360.), remainder(y, 360.), &t);
+  d = sumx(remainder(d, 360.), t, &t);
+  if (d == 0 || fabs(d) == 180)
+    d = copysign(d, t == 0 ? y - x : -t);
+  *e = t;
+  return d;
+}
+
+// sine and cosine of r radians plus q quarter turns; x gives the sign of a
+// zero sine
+static void sincos_quarter(double r, int q, double x,
+			   double* sinx, double* cosx) {
+  double s = sin(r), c = cos(r);
+  switch ((unsigned)q & 3U) {
+  case 0U: *sinx =  s; *cosx =  c; break;
+  case 1U: *sinx =  c; *cosx = -s; break;
+  case 2U: *sinx = -s; *cosx = -c; break;
+  default: *sinx = -c; *cosx =  s; break;
+  }
+  *cosx += 0.;
+  if (*sinx == 0) *sinx = copysign(*sinx, x);
+}
+
+// sine and cosine of x degrees, exact at multiples of 90
+static void sincosd(double x, double* sinx, double* cosx) {
+  int q = 0;
+  double r = remquo(x, 90., &q) * (M_PI / 180);
+  sincos_quarter(r, q, x, sinx, cosx);
+}
+
+// as sincosd() for x + t degrees, t a small correction to x
+static void sincosde(double x, double t, double* sinx, double* cosx) {
+  int q = 0;
+  double r = ang_round(remquo(x, 90., &q) + t) * (M_PI / 180);
+  sincos_quarter(r, q, x, sinx, cosx);
+}
+
+// sum(c[i] * sin(2 i x), i = 1..n) by Clenshaw summation
+static double sin_series(double sinx, double cosx, const double* c, int n) {
+  c += n + 1;
+  double ar = 2 * (cosx - sinx) * (cosx + sinx);
+  double y0 = (n & 1) ? *--c : 0, y1 = 0;
+  n /= 2;
+  while (n--) {
+    y1 = ar * y0 - y1 + *--c;
+    y0 = ar * y1 - y0 + *--c;
+  }
+  return 2 * sinx * cosx * y0;
+}
+
+static double A1m1f(double eps) {
+  static const double co[] = { 1, 4, 64, 0, 256 };
+  double t = polyval(3, co, sq(eps)) / co[4];
+  return (t + eps) / (1 - eps);
+}
+
+static void C1f(double eps, double* c) {
+  static const double co[] = {
+    -1, 6, -16, 32,
+    -9, 64, -128, 2048,
+    9, -16, 768,
+    3, -5, 512,
+    -7, 1280,
+    -7, 2048,
+  };
+  double eps2 = sq(eps), d = eps;
+  int o = 0;
+  for (int l = 1; l <= KARNEY_ORD; l++) {
+    int m = (KARNEY_ORD - l) / 2;
+    c[l] = d * polyval(m, co + o, eps2) / co[o + m + 1];
+    o += m + 2;
+    d *= eps;
+  }
+}
+
+static double A2m1f(double eps) {
+  static const double co[] = { -11, -28, -192, 0, 256 };
+  double t = polyval(3, co, sq(eps)) / co[4];
+  return (t - eps) / (1 + eps);
+}
+
+static void C2f(double eps, double* c) {
+  static const double co[] = {
+    1, 2, 16, 32,
+    35, 64, 384, 2048,
+    15, 80, 768,
+    7, 35, 512,
+    63, 1280,
+    77, 2048,
+  };
+  double eps2 = sq(eps), d = eps;
+  int o = 0;
+  for (int l = 1; l <= KARNEY_ORD; l++) {
+    int m = (KARNEY_ORD - l) / 2;
+    c[l] = d * polyval(m, co + o, eps2) / co[o + m + 1];
+    o += m + 2;
+    d *= eps;
+  }
+}
+
+static inline double A3f(double eps) {
+  return polyval(KARNEY_ORD - 1, coeff.A3x, eps);
+}
+
+static void C3f(double eps, double* c) {
+  double mult = 1;
+  int o = 0;
+  for (int l = 1; l < KARNEY_ORD; l++) {
+    int m = KARNEY_ORD - l - 1;
+    mult *= eps;
+    c[l] = mult * polyval(m, coeff.C3x + o, eps);
+    o += m + 1;
+  }
+}
+
+// distance (*s12b) and reduced length (*m12b) over b; either may be NULL
+static void lengths(double eps, double sig12,
+		    double ssig1, double csig1, double dn1,
+		    double ssig2, double csig2, double dn2,
+		    double* s12b, double* m12b) {
+
+  double Ca[KARNEY_NC], Cb[KARNEY_NC];
+  double A1 = A1m1f(eps), A2 = 0, m0 = 0, J12 = 0;
+  C1f(eps, Ca);
+  if (m12b) {
+    A2 = A2m1f(eps);
+    C2f(eps, Cb);
+    m0 = A1 - A2;
+    A2 = 1 + A2;
+  }
+  A1 = 1 + A1;
+
+  if (s12b) {
+    double B1 = sin_series(ssig2, csig2, Ca, KARNEY_ORD) -
+      sin_series(ssig1, csig1, Ca, KARNEY_ORD);
+    *s12b = A1 * (sig12 + B1);
+    if (m12b) {
+      double B2 = sin_series(ssig2, csig2, Cb, KARNEY_ORD) -
+	sin_series(ssig1, csig1, Cb, KARNEY_ORD);
+      J12 = m0 * sig12 + (A1 * B1 - A2 * B2);
+    }
+  } else if (m12b) {
+    for (int l = 1; l <= KARNEY_ORD; l++)
+      Cb[l] = A1 * Ca[l] - A2 * Cb[l];
+    J12 = m0 * sig12 + (sin_series(ssig2, csig2, Cb, KARNEY_ORD) -
+			sin_series(ssig1, csig1, Cb, KARNEY_ORD));
+  }
+
+  if (m12b)
+    *m12b = dn2 * (csig1 * ssig2) - dn1 * (ssig1 * csig2) -
+      csig1 * csig2 * J12;
+
+}
+
+// positive root k of k^4 + 2 k^3 - (x^2 + y^2 - 1) k^2 - 2 y^2 k - y^2
+static double astroid(double x, double y) {
+
+  double p = sq(x), q = sq(y), r = (p + q - 1) / 6;
+
+  if (q == 0 && r <= 0)
+    return 0;
+
+  double S = p * q / 4, r2 = sq(r), r3 = r * r2;
+  double disc = S * (S + 2 * r3);
+  double u = r;
+
+  if (disc >= 0) {
+    double T3 = S + r3;
+    T3 += T3 < 0 ? -sqrt(disc) : sqrt(disc);
+    double T = cbrt(T3);
+    u += T + (T != 0 ? r2 / T : 0);
+  } else {
+    double ang = atan2(sqrt(-disc), -(S + r3));
+    u += 2 * r * cos(ang / 3);
+  }
+
+  double v = sqrt(sq(u) + q);
+  double uv = u < 0 ? q / (v - u) : u + v;
+  double w = (uv - q) / (2 * v);
+
+  return uv / (sqrt(uv + sq(w)) + w);
+
+}
+
+// Starting azimuth for Newton's method in *salp1, *calp1, returning -1;
+// for short lines the arc length (with *dnm set), which needs no iteration
+static double inverse_start(double sbet1, double cbet1,
+			    double sbet2, double cbet2,
+			    double lam12, double slam12, double clam12,
+			    double* psalp1, double* pcalp1, double* pdnm) {
+
+  double sig12 = -1, salp1, calp1, dnm = 0;
+  double sbet12 = sbet2 * cbet1 - cbet2 * sbet1;
+  double cbet12 = cbet2 * cbet1 + sbet2 * sbet1;
+  double sbet12a = sbet2 * cbet1 + cbet2 * sbet1;
+  bool shortline = cbet12 >= 0 && sbet12 < 0.5 && cbet2 * lam12 < 0.5;
+  double somg12, comg12;
+
+  if (shortline) {
+    double sbetm2 = sq(sbet1 + sbet2);
+    sbetm2 /= sbetm2 + sq(cbet1 + cbet2);
+    dnm = sqrt(1 + kn_ep2 * sbetm2);
+    double omg12 = lam12 / (kn_f1 * dnm);
+    somg12 = sin(omg12);
+    comg12 = cos(omg12);
+  } else {
+    somg12 = slam12;
+    comg12 = clam12;
+  }
+
+  salp1 = cbet2 * somg12;
+  calp1 = comg12 >= 0 ?
+    sbet12 + cbet2 * sbet1 * sq(somg12) / (1 + comg12) :
+    sbet12a - cbet2 * sbet1 * sq(somg12) / (1 - comg12);
+
+  double ssig12 = hypot(salp1, calp1);
+  double csig12 = sbet1 * sbet2 + cbet1 * cbet2 * comg12;
+
+  if (shortline && ssig12 < etol2) {
+
+    // really short lines
+    sig12 = atan2(ssig12, csig12);
+
+  } else if (fabs(kn_n) > 0.1 || csig12 >= 0 ||
+	     ssig12 >= 6 * fabs(kn_n) * M_PI * sq(cbet1)) {
+
+    // the spherical starting point will do
+
+  } else {
+
+    // nearly antipodal: scale so that the antipode is at the origin and
+    // the singular point at x = -1, y = 0
+    double lam12x = atan2(-slam12, -clam12);
+    double k2 = sq(sbet1) * kn_ep2;
+    double eps = k2 / (2 * (1 + sqrt(1 + k2)) + k2);
+    double lamscale = kn_f * cbet1 * A3f(eps) * M_PI;
+    double betscale = lamscale * cbet1;
+    volatile double x = lam12x / lamscale;
+    double y = sbet12a / betscale;
+
+    if (y > -tol1 && x > -1 - xthresh) {
+      salp1 = std::min(1., -x);
+      calp1 = -sqrt(1 - sq(salp1));
+    } else {
+      double k = astroid(x, y);
+      double omg12a = lamscale * (-x * k / (1 + k));
+      somg12 = sin(omg12a);
+      comg12 = -cos(omg12a);
+      salp1 = cbet2 * somg12;
+      calp1 = sbet12a - cbet2 * sbet1 * sq(somg12) / (1 - comg12);
+    }
+
+  }
+
+  // backwards test lets NaN through
+  if (!(salp1 <= 0)) {
+    norm2(&salp1, &calp1);
+  } else {
+    salp1 = 1;
+    calp1 = 0;
+  }
+
+  *psalp1 = salp1;
+  *pcalp1 = calp1;
+  if (shortline) *pdnm = dnm;
+
+  return sig12;
+
+}
+
+// Longitude difference reached by the geodesic leaving point 1 at azimuth
+// alp1, less lam12, with the quantities lengths() needs for its distance
+// and, if diffp, the derivative with respect to alp1 in *dlam12
+static double lambda12(double sbet1, double cbet1, double dn1,
+		       double sbet2, double cbet2, double dn2,
+		       double salp1, double calp1,
+		       double slam12, double clam12,
+		       double* psig12,
+		       double* pssig1, double* pcsig1,
+		       double* pssig2, double* pcsig2,
+		       double* peps, bool diffp, double* pdlam12) {
+
+  double Ca[KARNEY_NC];
+
+  // break the degeneracy of the equatorial line
+  if (sbet1 == 0 && calp1 == 0)
+    calp1 = -tiny;
+
+  double salp0 = salp1 * cbet1;
+  double calp0 = hypot(calp1, salp1 * sbet1);
+
+  double ssig1 = sbet1, somg1 = salp0 * sbet1;
+  double csig1 = calp1 * cbet1, comg1 = calp1 * cbet1;
+  norm2(&ssig1, &csig1);
+
+  // take care with the symmetric case |bet2| = -bet1
+  double calp2 = cbet2 != cbet1 || fabs(sbet2) != -sbet1 ?
+    sqrt(sq(calp1 * cbet1) +
+	 (cbet1 < -sbet1 ?
+	  (cbet2 - cbet1) * (cbet1 + cbet2) :
+	  (sbet1 - sbet2) * (sbet1 + sbet2))) / cbet2 :
+    fabs(calp1);
+
+  double ssig2 = sbet2, somg2 = salp0 * sbet2;
+  double csig2 = calp2 * cbet2, comg2 = calp2 * cbet2;
+  norm2(&ssig2, &csig2);
+
+  // sig12 and omg12 limited to [0, pi]
+  double sig12 = atan2(std::max(0., csig1 * ssig2 - ssig1 * csig2) + 0.,
+		       csig1 * csig2 + ssig1 * ssig2);
+  double somg12 = std::max(0., comg1 * somg2 - somg1 * comg2) + 0.;
+  double comg12 = comg1 * comg2 + somg1 * somg2;
+
+  double eta = atan2(somg12 * clam12 - comg12 * slam12,
+		     comg12 * clam12 + somg12 * slam12);
+  double k2 = sq(calp0) * kn_ep2;
+  double eps = k2 / (2 * (1 + sqrt(1 + k2)) + k2);
+  C3f(eps, Ca);
+  double B312 = sin_series(ssig2, csig2, Ca, KARNEY_ORD - 1) -
+    sin_series(ssig1, csig1, Ca, KARNEY_ORD - 1);
+  double lam12 = eta - kn_f * A3f(eps) * salp0 * (sig12 + B312);
+
+  if (diffp) {
+    if (calp2 == 0) {
+      *pdlam12 = -2 * kn_f1 * dn1 / sbet1;
+    } else {
+      lengths(eps, sig12, ssig1, csig1, dn1, ssig2, csig2, dn2,
+	      NULL, pdlam12);
+      *pdlam12 *= kn_f1 / (calp2 * cbet2);
+    }
+  }
+
+  *psig12 = sig12;
+  *pssig1 = ssig1;
+  *pcsig1 = csig1;
+  *pssig2 = ssig2;
+  *pcsig2 = csig2;
+  *peps = eps;
+
+  return lam12;
+
+}
+
+// Karney inverse solution: distance in meters between two points given in
+// degrees; NaN if either latitude is outside [-90, 90]
+double karney_inverse(double xlon, double xlat, double ylon, double ylat) {
+
+  double lat1 = xlat, lat2 = ylat;
+
+  // longitude difference, made positive, with its rounding error
+  double lon12s;
+  double lon12 = ang_diff(xlon, ylon, &lon12s);
+  double lonsign = std::signbit(lon12) ? -1 : 1;
+  lon12 *= lonsign;
+  lon12s *= lonsign;
+  double lam12 = lon12 * (M_PI / 180);
+  double slam12, clam12;
+  sincosde(lon12, lon12s, &slam12, &clam12);
+  lon12s = (180 - lon12) - lon12s;
+
+  // latitudes, treating those very near the equator as on it
+  lat1 = ang_round(fabs(lat1) > 90 ? NAN : lat1);
+  lat2 = ang_round(fabs(lat2) > 90 ? NAN : lat2);
+
+  // point with the larger |latitude| first, then make lat1 <= -0, so that
+  // 0 <= lon12 <= 180 and lat1 <= lat2 <= -lat1
+  if (fabs(lat1) < fabs(lat2) || lat2 != lat2)
+    std::swap(lat1, lat2);
+  double latsign = std::signbit(lat1) ? 1 : -1;
+  lat1 *= latsign;
+  lat2 *= latsign;
+
+  // reduced latitudes, cos(bet) kept positive at the poles
+  double sbet1, cbet1, sbet2, cbet2;
+  sincosd(lat1, &sbet1, &cbet1);
+  sbet1 *= kn_f1;
+  norm2(&sbet1, &cbet1);
+  cbet1 = std::max(tiny, cbet1);
+  sincosd(lat2, &sbet2, &cbet2);
+  sbet2 *= kn_f1;
+  norm2(&sbet2, &cbet2);
+  cbet2 = std::max(tiny, cbet2);
+
+  // force bet2 = +/- bet1 where they differ only by rounding
+  if (cbet1 < -sbet1) {
+    if (cbet2 == cbet1) sbet2 = copysign(sbet1, sbet2);
+  } else {
+    if (fabs(sbet2) == -sbet1) cbet2 = cbet1;
+  }
+
+  double dn1 = sqrt(1 + kn_ep2 * sq(sbet1));
+  double dn2 = sqrt(1 + kn_ep2 * sq(sbet2));
+
+  double s12x = 0, m12x = 0, sig12;
+  bool meridian = lat1 == -90 || slam12 == 0;
+
+  if (meridian) {
+
+    // both points on one meridian: the geodesic may run along it
+    double calp1 = clam12;
+    double ssig1 = sbet1, csig1 = calp1 * cbet1;
+    double ssig2 = sbet2, csig2 = cbet2;
+
+    sig12 = atan2(std::max(0., csig1 * ssig2 - ssig1 * csig2) + 0.,
+		  csig1 * csig2 + ssig1 * ssig2);
+    lengths(kn_n, sig12, ssig1, csig1, dn1, ssig2, csig2, dn2,
+	    &s12x, &m12x);
+
+    if (sig12 < 1 || m12x >= 0) {
+      if (sig12 < 3 * tiny || (sig12 < tol0 && (s12x < 0 || m12x < 0)))
+	s12x = 0;
+      s12x *= kn_b;
+    } else {
+      meridian = false;
+    }
+
+  }
+
+  if (!meridian && sbet1 == 0 && (kn_f <= 0 || lon12s >= kn_f * 180)) {
+
+    // geodesic runs along the equator
+    s12x = a * lam12;
+
+  } else if (!meridian) {
+
+    double salp1, calp1, dnm = 0;
+    sig12 = inverse_start(sbet1, cbet1, sbet2, cbet2,
+			  lam12, slam12, clam12, &salp1, &calp1, &dnm);
+
+    if (sig12 >= 0) {
+
+      // short line
+      s12x = sig12 * kn_b * dnm;
+
+    } else {
+
+      // Newton's method on alp1, keeping (alp1a, alp1b) around the root
+      // and bisecting when a step leaves it or the slope is not positive
+      double ssig1 = 0, csig1 = 0, ssig2 = 0, csig2 = 0, eps = 0;
+      double salp1a = tiny, calp1a = 1, salp1b = tiny, calp1b = -1;
+      bool tripn = false, tripb = false;
+
+      for (int numit = 0;; numit++) {
+
+	double dv = 0;
+	double v = lambda12(sbet1, cbet1, dn1, sbet2, cbet2, dn2,
+			    salp1, calp1, slam12, clam12, &sig12,
+			    &ssig1, &csig1, &ssig2, &csig2, &eps,
+			    numit < KARNEY_MAXIT1, &dv);
+
+	// reversed test lets NaN out
+	if (tripb || !(fabs(v) >= (tripn ? 8 : 1) * tol0) ||
+	    numit == KARNEY_MAXIT2)
+	  break;
+
+	if (v > 0 && (numit > KARNEY_MAXIT1 ||
+		      calp1 / salp1 > calp1b / salp1b)) {
+	  salp1b = salp1;
+	  calp1b = calp1;
+	} else if (v < 0 && (numit > KARNEY_MAXIT1 ||
+			     calp1 / salp1 < calp1a / salp1a)) {
+	  salp1a = salp1;
+	  calp1a = calp1;
+	}
+
+	if (numit < KARNEY_MAXIT1 && dv > 0) {
+	  double dalp1 = -v / dv;
+	  if (fabs(dalp1) < M_PI) {
+	    double sdalp1 = sin(dalp1), cdalp1 = cos(dalp1);
+	    double nsalp1 = salp1 * cdalp1 + calp1 * sdalp1;
+	    if (nsalp1 > 0) {
+	      calp1 = calp1 * cdalp1 - salp1 * sdalp1;
+	      salp1 = nsalp1;
+	      norm2(&salp1, &calp1);
+	      tripn = fabs(v) <= 16 * tol0;
+	      continue;
+	    }
+	  }
+	}
+
+	// bisect
+	salp1 = (salp1a + salp1b) / 2;
+	calp1 = (calp1a + calp1b) / 2;
+	norm2(&salp1, &calp1);
+	tripn = false;
+	tripb = (fabs(salp1a - salp1) + (calp1a - calp1) < tolb ||
+		 fabs(salp1 - salp1b) + (calp1 - calp1b) < tolb);
+
+      }
+
+      lengths(eps, sig12, ssig1, csig1, dn1, ssig2, csig2, dn2,
+	      &s12x, NULL);
+      s12x *= kn_b;
+
+    }
+
+  }
+
+  // convert -0 to 0
+  return 0. + s12x;
+
+}
@@ -0,0 +1,486 @@
+// mtom_io.cpp
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DISTRCPP_MMAP 1
+#endif
+#include <parallel.h>
+#include <points.h>
+#include <simd.h>
+#include <shared.h>
+#include <Rcpp.h>
+
+// Distance matrix file: a fixed header, then the n x k matrix in column
+// order (as R holds a matrix) from data_off, a multiple of MTOM_FILE_ALIGN
+// bytes, so a column or a run of rows within one is a single read. Values
+// are written as they are held in memory; the header records the byte
+// order and value type, and a file written under a different layout is
+// refused rather than converted. MTOM_FILE_VERSION goes up whenever the
+// layout changes.
+
+#define MTOM_FILE_MAGIC "DRCPMTX"
+#define MTOM_FILE_VERSION 1
+#define MTOM_FILE_ALIGN 64
+#define MTOM_FILE_ENDIAN 0x0102030405060708ULL
+
+// bytes of distances held in memory at once while writing
+#define MTOM_FILE_SLAB_BYTES (64 << 20)
+
+// value types of the matrix, one for each output type (see out_kind) in
+// the same order
+enum mtom_dtype { MTOM_FLOAT64 = 1, MTOM_FLOAT32, MTOM_METERS32,
+		  MTOM_DECIMETERS32 };
+
+static int mtom_dtype_of(int output) { return MTOM_FLOAT64 + output; }
+
+static int mtom_output_of(uint64_t dtype) { return dtype - MTOM_FLOAT64; }
+
+static size_t mtom_value_bytes(uint64_t dtype) {
+  return dtype == MTOM_FLOAT64 ? sizeof(double) : sizeof(int);
+}
+
+// all fields are 8 bytes wide, so the struct has no padding
+struct MtomFileHeader {
+
+  char magic[8];
+  uint64_t version;
+  uint64_t endian;
+  uint64_t n;
+  uint64_t k;
+  uint64_t dtype;
+  uint64_t value_bytes;
+
+  // distance function, NUL padded, and the ellipsoid it measured on (f is
+  // 0 for the sphere of Haversine distances)
+  char dist_function[16];
+  double a_axis;
+  double flattening;
+
+  uint64_t data_off;
+  uint64_t file_bytes;
+
+};
+
+// check header h of a file of file_bytes bytes; stops if it cannot be read
+static void check_mtom_header(const MtomFileHeader& h, uint64_t file_bytes,
+			      const std::string& path) {
+
+  if (std::memcmp(h.magic, MTOM_FILE_MAGIC, sizeof(MTOM_FILE_MAGIC)) != 0)
+    Rcpp::stop(path + " is not a distance matrix file");
+
+  if (h.version != MTOM_FILE_VERSION)
+    Rcpp::stop(path + " has distance matrix file version " +
+	       std::to_string(h.version) + "; this version of distRcpp reads " +
+	       std::to_string(MTOM_FILE_VERSION) + ", so write it again");
+
+  if (h.endian != MTOM_FILE_ENDIAN || h.dtype < MTOM_FLOAT64 ||
+      h.dtype > MTOM_DECIMETERS32 || h.value_bytes != mtom_value_bytes(h.dtype))
+    Rcpp::stop(path + " was written on a machine with a different layout; "
+	       "write it again");
+
+  // the matrix must fill the file exactly
+  bool ok = h.data_off % MTOM_FILE_ALIGN == 0 && h.data_off >= sizeof(h) &&
+    h.file_bytes == file_bytes && h.data_off <= file_bytes &&
+    (h.k == 0 || h.n <= (file_bytes - h.data_off) / h.value_bytes / h.k) &&
+    h.data_off + h.n * h.k * h.value_bytes == file_bytes;
+
+  if (!ok)
+    Rcpp::stop(path + " is truncated or damaged");
+
+}
+
+//' Compute distance between each coordinate pair (many to many)
+//' and write the matrix to a file.
+//'
+//' For matrices too large to hold in memory: the same distances as
+//' \code{dist_mtom()} are computed a slab of columns at a time and
+//' written to a binary file, so memory use stays at about 64 MB however
+//' many columns the matrix has. A slab holds at least one column, so
+//' past about 8 million rows (16 million in the 4-byte output types) it
+//' takes one column's worth instead. Read back any rows and columns with
+//' \code{dist_mtom_read()}, which maps the file into memory, and see its
+//' dimensions and how it was computed with \code{dist_mtom_info()}.
+//'
+//' The file holds a small header (dimensions, value type, distance
+//' function and ellipsoid) followed by the matrix in column order, 8
+//' bytes per pair as doubles or 4 in the other output types. It is
+//' written next to \code{path} and then renamed over it. Files store
+//' numbers as they are held in memory and can only be read on machines
+//' with the same byte order.
+//'
+//' @param xlon Vector of longitudes for starting coordinate pairs, or
+//' prepared point set (see \code{prepare_points()})
+//' @param xlat Vector of latitudes for starting coordinate pairs; ignored
+//' (use \code{NULL}) when \code{xlon} is a prepared point set
+//' @param ylon Vector of longitudes for ending coordinate pairs, or
+//' prepared point set
+//' @param ylat Vector of latitudes for ending coordinate pairs; ignored
+//' (use \code{NULL}) when \code{ylon} is a prepared point set
+//' @param path String path of file to write
+//' @param dist_function String name of distance function: Haversine, Vincenty, Karney,
+//' Andoyer, Thomas, Euclidean, Manhattan, Fast
+//' @param block_size Integer number of points per tile edge; 0 (default)
+//' picks a tile that fits in a typical L2 cache
+//' @param nthreads Integer number of threads; 0 (default) uses
+//' \code{getOption("distRcpp.nthreads")}, then the \code{DISTRCPP_NTHREADS}
+//' environment variable, then 1
+//' @param output String type of stored distances, as in \code{dist_mtom()}
+//' @return \code{path}
+//' @export
+// [[Rcpp::export]]
+SEXP dist_mtom_file(SEXP xlon,
+		    SEXP xlat,
+		    SEXP ylon,
+		    SEXP ylat,
+		    std::string path,
+		    std::string dist_function = "Haversine",
+		    int block_size = 0,
+		    int nthreads = 0,
+		    std::string output = "double") {
+
+  // select function and value type
+  int kind = dist_kind_of(dist_function);
+  int otype = out_kind_of(output);
+
+  // each point is paired many times, so prepare both sets once
+  PointSet xtmp, ytmp;
+  const PointSet& xp = points_of(xlon, xlat, xtmp);
+  const PointSet& yp = points_of(ylon, ylat, ytmp);
+
+  R_xlen_t n = xp.n;
+  R_xlen_t k = yp.n;
+  int bs = tile_size(block_size);
+  int nt = resolve_threads(nthreads);
+
+  // layout
+  MtomFileHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, MTOM_FILE_MAGIC, sizeof(MTOM_FILE_MAGIC));
+  h.version = MTOM_FILE_VERSION;
+  h.endian = MTOM_FILE_ENDIAN;
+  h.n = n;
+  h.k = k;
+  h.dtype = mtom_dtype_of(otype);
+  h.value_bytes = mtom_value_bytes(h.dtype);
+  std::strncpy(h.dist_function, dist_function.c_str(),
+	       sizeof(h.dist_function) - 1);
+  h.a_axis = dist_is_planar(kind) ? 0. : a;
+  h.flattening = (kind == DIST_HAVERSINE || kind == DIST_FAST ||
+		  dist_is_planar(kind)) ? 0. : f;
+  h.data_off = (sizeof(h) + MTOM_FILE_ALIGN - 1) / MTOM_FILE_ALIGN *
+    MTOM_FILE_ALIGN;
+  h.file_bytes = h.data_off + (uint64_t)n * k * h.value_bytes;
+
+  // columns per slab
+  R_xlen_t slab = std::max((R_xlen_t)1, (R_xlen_t)(MTOM_FILE_SLAB_BYTES /
+	  h.value_bytes / std::max((R_xlen_t)1, n)));
+  slab = std::min(slab, std::max((R_xlen_t)1, k));
+  std::vector<char> buf((size_t)slab * n * h.value_bytes);
+  void* out = buf.data();
+
+  // write under a temporary name, then rename over path
+  std::string tmp = path + ".tmp";
+  std::FILE* fp = std::fopen(tmp.c_str(), "wb");
+
+  if (fp == NULL)
+    Rcpp::stop("cannot open " + tmp + " for writing");
+
+  std::vector<char> head(h.data_off, 0);
+  std::memcpy(head.data(), &h, sizeof(h));
+  bool ok = std::fwrite(head.data(), 1, head.size(), fp) == head.size();
+
+  for (R_xlen_t c0 = 0; ok && c0 < k; c0 += slab) {
+
+    R_xlen_t c1 = std::min(c0 + slab, k);
+
+    // as in dist_mtom(), each chunk is a run of columns whose tiles are
+    // walked so that each column segment is written contiguously
+    try {
+      parallel_for(c1 - c0, row_grain(n), nt, [&](R_xlen_t jb, R_xlen_t jend) {
+
+	  // compact types are converted from a segment of doubles
+	  std::vector<double> seg(otype == OUT_DOUBLE ? 0 : bs);
+
+	  for(R_xlen_t ib = 0; ib < n; ib += bs) {
+
+	    R_xlen_t iend = std::min(ib + bs, n);
+
+	    for(R_xlen_t j = jb; j < jend; j++) {
+
+	      // batch kernel over the column segment
+	      if (otype == OUT_DOUBLE) {
+		double* col = static_cast<double*>(out) + j * n;
+		batch_prep_1tom(kind, yp, c0 + j, xp, ib, iend, col + ib);
+	      } else {
+		batch_prep_1tom(kind, yp, c0 + j, xp, ib, iend, seg.data());
+		store_dist(otype, seg.data(), iend - ib, out, j * n + ib);
+	      }
+
+	    }
+	  }
+	});
+    } catch (...) {
+      std::fclose(fp);
+      std::remove(tmp.c_str());
+      throw;
+    }
+
+    size_t bytes = (size_t)(c1 - c0) * n * h.value_bytes;
+    ok = std::fwrite(out, 1, bytes, fp) == bytes;
+
+  }
+
+  ok = (std::fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+  // rename() does not replace an existing file here
+  if (ok)
+    std::remove(path.c_str());
+#endif
+
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    Rcpp::stop("cannot write distance matrix to " + path);
+  }
+
+  return Rcpp::wrap(path);
+
+}
+
+// Open distance matrix file at path: its header into h and, where memory
+// mapping is available, the whole file mapped at *base (NULL otherwise,
+// with the file left open at *fp); release with close_mtom().
+static void open_mtom(const std::string& path, MtomFileHeader& h,
+		      const char** base, size_t* map_bytes, std::FILE** fp) {
+
+  *base = NULL;
+  *map_bytes = 0;
+  *fp = NULL;
+
+#ifdef DISTRCPP_MMAP
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    Rcpp::stop("cannot open " + path);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(h)) {
+    close(fd);
+    Rcpp::stop(path + " is not a distance matrix file");
+  }
+
+  // the mapping stays valid after the descriptor is closed
+  void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (map == MAP_FAILED)
+    Rcpp::stop("cannot map " + path + " into memory");
+
+  *base = static_cast<const char*>(map);
+  *map_bytes = st.st_size;
+  std::memcpy(&h, *base, sizeof(h));
+
+  try {
+    check_mtom_header(h, st.st_size, path);
+  } catch (...) {
+    munmap(map, st.st_size);
+    throw;
+  }
+
+#else
+
+  *fp = std::fopen(path.c_str(), "rb");
+  if (*fp == NULL)
+    Rcpp::stop("cannot open " + path);
+
+  _fseeki64(*fp, 0, SEEK_END);
+  uint64_t bytes = _ftelli64(*fp);
+  _fseeki64(*fp, 0, SEEK_SET);
+
+  bool ok = bytes >= sizeof(h) && std::fread(&h, 1, sizeof(h), *fp) == sizeof(h);
+
+  try {
+    if (!ok)
+      Rcpp::stop(path + " is not a distance matrix file");
+    check_mtom_header(h, bytes, path);
+  } catch (...) {
+    std::fclose(*fp);
+    throw;
+  }
+
+#endif
+
+}
+
+static void close_mtom(const char* base, size_t map_bytes, std::FILE* fp) {
+#ifdef DISTRCPP_MMAP
+  if (base != NULL)
+    munmap(const_cast<char*>(base), map_bytes);
+#endif
+  if (fp != NULL)
+    std::fclose(fp);
+}
+
+// 0-based indices from 1-based idx (all of [0, n) if NULL); stops naming
+// what if any is missing or out of range
+static std::vector<R_xlen_t> mtom_indices(SEXP idx, R_xlen_t n,
+					  const std::string& what) {
+
+  std::vector<R_xlen_t> out;
+
+  if (Rf_isNull(idx)) {
+    out.resize(n);
+    for (R_xlen_t j = 0; j < n; j++)
+      out[j] = j;
+    return out;
+  }
+
+  Rcpp::NumericVector v(idx);
+  out.resize(v.size());
+  for (R_xlen_t j = 0; j < v.size(); j++) {
+    double x = v[j];
+    if (!(x >= 1 && x <= n) || x != (R_xlen_t)x)
+      Rcpp::stop(what + " must be whole numbers between 1 and " +
+		 std::to_string((long long)n));
+    out[j] = (R_xlen_t)x - 1;
+  }
+
+  return out;
+
+}
+
+// copy rows ri of column col (values of type T) to res from element at
+template <class T>
+static void mtom_copy_rows(const char* col, const std::vector<R_xlen_t>& ri,
+			   void* res, R_xlen_t at) {
+  const T* c = reinterpret_cast<const T*>(col);
+  T* o = static_cast<T*>(res) + at;
+  for (size_t r = 0; r < ri.size(); r++)
+    o[r] = c[ri[r]];
+}
+
+//' Read rows and columns of a distance matrix file.
+//'
+//' Returns the given rows and columns of a matrix written by
+//' \code{dist_mtom_file()}, as \code{dist_mtom()} would have returned them.
+//' The file is mapped into memory read only, so only the pages holding the
+//' requested values are read from disk; reading whole columns is fastest,
+//' as each is stored contiguously. On Windows the values are read from the
+//' file instead.
+//'
+//' @param path String path of file written by \code{dist_mtom_file()}
+//' @param rows Integer vector of rows (starting points) to read; \code{NULL}
+//' (default) reads all
+//' @param cols Integer vector of columns (ending points) to read;
+//' \code{NULL} (default) reads all
+//' @return Matrix of distances in meters, of the type the file was
+//' written with (see \code{output} in \code{dist_mtom()})
+//' @export
+// [[Rcpp::export]]
+SEXP dist_mtom_read(std::string path,
+		    SEXP rows = R_NilValue,
+		    SEXP cols = R_NilValue) {
+
+  MtomFileHeader h;
+  const char* base;
+  size_t map_bytes;
+  std::FILE* fp;
+  open_mtom(path, h, &base, &map_bytes, &fp);
+
+  std::vector<R_xlen_t> ri, ci;
+  try {
+    ri = mtom_indices(rows, h.n, "rows");
+    ci = mtom_indices(cols, h.k, "cols");
+  } catch (...) {
+    close_mtom(base, map_bytes, fp);
+    throw;
+  }
+
+  R_xlen_t nr = ri.size();
+  R_xlen_t nc = ci.size();
+  size_t vb = h.value_bytes;
+  void* res;
+  Rcpp::RObject out = alloc_dist(mtom_output_of(h.dtype), nr * nc, &res);
+  out.attr("dim") = Rcpp::IntegerVector::create(nr, nc);
+
+  // span of rows to read from each column where there is no mapping
+  R_xlen_t lo = nr > 0 ? *std::min_element(ri.begin(), ri.end()) : 0;
+  R_xlen_t hi = nr > 0 ? *std::max_element(ri.begin(), ri.end()) + 1 : 0;
+  std::vector<char> span(base == NULL ? (hi - lo) * vb : 0);
+  bool ok = true;
+
+  for (R_xlen_t c = 0; ok && c < nc; c++) {
+
+    uint64_t at = h.data_off + (uint64_t)ci[c] * h.n * vb;
+    const char* col;
+
+    if (base != NULL) {
+      col = base + at;
+    } else {
+#ifndef DISTRCPP_MMAP
+      ok = _fseeki64(fp, at + lo * vb, SEEK_SET) == 0 &&
+	std::fread(span.data(), vb, hi - lo, fp) == (size_t)(hi - lo);
+#endif
+      col = span.data() - lo * vb;
+    }
+
+    if (!ok)
+      break;
+
+    if (vb == sizeof(double))
+      mtom_copy_rows<double>(col, ri, res, c * nr);
+    else
+      mtom_copy_rows<int>(col, ri, res, c * nr);
+
+  }
+
+  close_mtom(base, map_bytes, fp);
+
+  if (!ok)
+    Rcpp::stop("cannot read " + path);
+
+  return out;
+
+}
+
+//' Describe a distance matrix file.
+//'
+//' @param path String path of file written by \code{dist_mtom_file()}
+//' @return List with the number of \code{rows} (starting points) and
+//' \code{cols} (ending points), the value type \code{dtype} (the
+//' \code{output} it was written with), the \code{dist_function} used, the
+//' semi-major axis \code{a} in meters and flattening \code{f} of the
+//' ellipsoid it measured on (0 for the sphere of Haversine and Fast
+//' distances; both 0 for Euclidean and Manhattan distances), and the file
+//' size in \code{bytes}
+//' @export
+// [[Rcpp::export]]
+Rcpp::List dist_mtom_info(std::string path) {
+
+  MtomFileHeader h;
+  const char* base;
+  size_t map_bytes;
+  std::FILE* fp;
+  open_mtom(path, h, &base, &map_bytes, &fp);
+  close_mtom(base, map_bytes, fp);
+
+  char fn[sizeof(h.dist_function) + 1] = { 0 };
+  std::memcpy(fn, h.dist_function, sizeof(h.dist_function));
+
+  return Rcpp::List::create(Rcpp::Named("rows") = (double)h.n,
+			    Rcpp::Named("cols") = (double)h.k,
+			    Rcpp::Named("dtype") =
+			    std::string(out_kind_name(mtom_output_of(h.dtype))),
+			    Rcpp::Named("dist_function") = std::string(fn),
+			    Rcpp::Named("a") = h.a_axis,
+			    Rcpp::Named("f") = h.flattening,
+			    Rcpp::Named("bytes") = (double)h.file_bytes);
+
+}
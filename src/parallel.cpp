@@ -0,0 +1,38 @@
+// parallel.cpp
+#include <parallel.h>
+#include <Rcpp.h>
+#include <cstdlib>
+
+// function to resolve requested number of threads: an explicit positive
+// value wins, then option(distRcpp.nthreads), then the DISTRCPP_NTHREADS
+// environment variable, then a single thread
+int resolve_threads(int nthreads) {
+
+  if (nthreads < 1) {
+
+    SEXP opt = Rf_GetOption1(Rf_install("distRcpp.nthreads"));
+
+    if (!Rf_isNull(opt))
+      nthreads = Rf_asInteger(opt);
+
+  }
+
+  if (nthreads < 1) {
+
+    const char* env = std::getenv("DISTRCPP_NTHREADS");
+
+    if (env != NULL)
+      nthreads = std::atoi(env);
+
+  }
+
+  if (nthreads < 1)
+    nthreads = 1;
+
+#ifdef _OPENMP
+  return nthreads;
+#else
+  return 1;
+#endif
+
+}
@@ -0,0 +1,196 @@
+// points.cpp
+#include <geotree.h>
+#include <points.h>
+#include <shared.h>
+#include <Rcpp.h>
+
+// point the columns of p at block
+void point_columns(PointSet& p, const double* block, R_xlen_t n) {
+
+  p.n = n;
+  p.lon = block;
+  p.lat = block + n;
+  p.lonr = block + 2 * n;
+  p.latr = block + 3 * n;
+  p.clat = block + 4 * n;
+  p.shlat = block + 5 * n;
+  p.chlat = block + 6 * n;
+  p.shlon = block + 7 * n;
+  p.chlon = block + 8 * n;
+  p.sU = block + 9 * n;
+  p.cU = block + 10 * n;
+
+}
+
+// fill p from n points in degrees
+void prepare_into(PointSet& p, const double* lon, const double* lat,
+		  R_xlen_t n) {
+
+  p.store.assign(n * POINT_COLUMNS, 0.);
+
+  double* col[POINT_COLUMNS];
+  for (int c = 0; c < POINT_COLUMNS; c++)
+    col[c] = p.store.data() + c * n;
+
+  for (R_xlen_t i = 0; i < n; i++) {
+
+    double lonr = deg_to_rad(lon[i]);
+    double latr = deg_to_rad(lat[i]);
+
+    // reduced latitude as in dist_vincenty()
+    double U = atan((1. - f) * tan(latr));
+
+    col[0][i] = lon[i];
+    col[1][i] = lat[i];
+    col[2][i] = lonr;
+    col[3][i] = latr;
+    col[4][i] = cos(latr);
+    col[5][i] = sin(latr / 2.);
+    col[6][i] = cos(latr / 2.);
+    col[7][i] = sin(lonr / 2.);
+    col[8][i] = cos(lonr / 2.);
+    col[9][i] = sin(U);
+    col[10][i] = cos(U);
+
+  }
+
+  point_columns(p, p.store.data(), n);
+
+}
+
+// prepared set behind an external pointer; NULL if x is not one
+const PointSet* as_points(SEXP x) {
+
+  if (TYPEOF(x) != EXTPTRSXP || !Rf_inherits(x, "distRcpp_points"))
+    return NULL;
+
+  Rcpp::XPtr<PointSet> ptr(x);
+
+  // external pointers do not survive saving and reloading
+  if (ptr.get() == NULL)
+    Rcpp::stop("prepared point set is no longer valid; prepare it again");
+
+  return ptr.get();
+
+}
+
+// coordinates for lon / lat vectors: the prepared set if lon is one,
+// otherwise tmp filled from the vectors
+const PointSet& points_of(SEXP lon, SEXP lat, PointSet& tmp) {
+
+  const PointSet* p = as_points(lon);
+  if (p != NULL)
+    return *p;
+
+  Rcpp::NumericVector lo(lon);
+  Rcpp::NumericVector la(lat);
+
+  if (lo.size() != la.size())
+    Rcpp::stop("longitude and latitude vectors differ in length");
+
+  prepare_into(tmp, lo.begin(), la.begin(), lo.size());
+  return tmp;
+
+}
+
+// coordinates for a data frame, or a prepared set or geo index built
+// from one
+const PointSet& frame_points(SEXP x_df, std::string lon_col,
+			     std::string lat_col, PointSet& tmp) {
+
+  const PointSet* p = as_points(x_df);
+  if (p != NULL)
+    return *p;
+
+  // an index keeps its points in tree order
+  const GeoIndex* g = as_geo_index(x_df);
+  if (g != NULL) {
+    geo_tree_points(g->tree, tmp);
+    return tmp;
+  }
+
+  Rcpp::DataFrame df(x_df);
+  Rcpp::NumericVector lon = df[lon_col];
+  Rcpp::NumericVector lat = df[lat_col];
+
+  prepare_into(tmp, lon.begin(), lat.begin(), lon.size());
+  return tmp;
+
+}
+
+// data frame behind x_df: x_df itself or the one a prepared set or
+// index was built from
+Rcpp::DataFrame frame_of(SEXP x_df) {
+
+  if (as_points(x_df) == NULL && as_geo_index(x_df) == NULL)
+    return Rcpp::DataFrame(x_df);
+
+  SEXP df = R_ExternalPtrProtected(x_df);
+
+  if (TYPEOF(df) != VECSXP && as_points(x_df) != NULL)
+    Rcpp::stop("prepared point set was built from vectors; "
+	       "prepare it from a data frame to use it here");
+
+  if (TYPEOF(df) != VECSXP)
+    Rcpp::stop("geo index was loaded without its data frame; "
+	       "pass y_df to geo_index_load() to use it here");
+
+  return Rcpp::DataFrame(df);
+
+}
+
+//' Prepare coordinates for repeated distance calculations.
+//'
+//' Converts a set of coordinates once into the form the distance kernels
+//' use (radians, sines and cosines of latitude and of the reduced
+//' latitude) and returns it as an external pointer. A prepared set can be
+//' passed in place of a longitude vector (the latitude argument is then
+//' ignored) to \code{dist_mtom()}, \code{dist_df()} and \code{dist_1tom()},
+//' and, when prepared from a data frame, in place of that data frame to
+//' \code{dist_min()}, \code{dist_max()}, \code{dist_sum_inv()},
+//' \code{dist_weighted_mean()} and \code{popdist_weighted_mean()}. Column
+//' name arguments for coordinates are then ignored; other columns (ids,
+//' measures, population) are read from the data frame. This saves work
+//' when the same points are queried repeatedly. Prepared sets do not
+//' survive saving and reloading a session.
+//'
+//' @param x Vector of longitudes, or DataFrame with coordinates
+//' @param lat Vector of latitudes when \code{x} is a vector
+//' @param lon_col String name of column in x with longitude values
+//' @param lat_col String name of column in x with latitude values
+//' @return External pointer of class \code{distRcpp_points}
+//' @export
+// [[Rcpp::export]]
+SEXP prepare_points(SEXP x,
+		    SEXP lat = R_NilValue,
+		    std::string lon_col = "lon",
+		    std::string lat_col = "lat") {
+
+  bool is_df = Rf_inherits(x, "data.frame");
+
+  // owned by R from here on, so nothing leaks if a column is missing;
+  // a data frame is kept alive alongside for its other columns
+  Rcpp::XPtr<PointSet> ptr(new PointSet, true, R_NilValue,
+			   is_df ? x : R_NilValue);
+  ptr.attr("class") = "distRcpp_points";
+
+  if (is_df) {
+
+    Rcpp::DataFrame df(x);
+    Rcpp::NumericVector lo = df[lon_col];
+    Rcpp::NumericVector la = df[lat_col];
+    prepare_into(*ptr, lo.begin(), la.begin(), lo.size());
+
+  } else {
+
+    Rcpp::NumericVector lo(x);
+    Rcpp::NumericVector la(lat);
+    if (lo.size() != la.size())
+      Rcpp::stop("longitude and latitude vectors differ in length");
+    prepare_into(*ptr, lo.begin(), la.begin(), lo.size());
+
+  }
+
+  return ptr;
+
+}
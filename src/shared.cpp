@@ -1,4 +1,7 @@
 // shared.cpp
+#include <climits>
+#include <cstring>
+#include <kernels.h>
 #include <shared.h>
 #include <Rcpp.h>
 
@@ -26,20 +29,8 @@ double dist_haversine(const double& xlon,
 		      const double& ylon,
 		      const double& ylat) {
 
-  // return 0 if same point
-  if (xlon == ylon && xlat == ylat) return 0;
+  return KernelHaversine::pair(xlon, xlat, ylon, ylat);
 
-  // convert degrees to radians
-  double xlonr = deg_to_rad(xlon);
-  double xlatr = deg_to_rad(xlat);
-  double ylonr = deg_to_rad(ylon);
-  double ylatr = deg_to_rad(ylat);
-
-  // compute parenthetical: sin(delta / 2)
-  double d1 = sin((ylatr - xlatr) / 2.);
-  double d2 = sin((ylonr - xlonr) / 2.);
-
-  return 2.0 * a * asin(sqrt(d1 * d1 + cos(xlatr) * cos(ylatr) * d2 * d2));
 }
 
 //' Compute Vincenty distance between two points
@@ -56,22 +47,42 @@ double dist_vincenty(const double& xlon,
 		     const double& ylon,
 		     const double& ylat) {
 
-  // return 0 if same point
-  if (xlon == ylon && xlat == ylat) return 0;
-
-  // convert degrees to radians
-  double xlonr = deg_to_rad(xlon);
-  double xlatr = deg_to_rad(xlat);
-  double ylonr = deg_to_rad(ylon);
-  double ylatr = deg_to_rad(ylat);
-
-  double U1 = atan((1. - f) * tan(xlatr));
-  double U2 = atan((1. - f) * tan(ylatr));
-  double sinU1 = sin(U1);
-  double sinU2 = sin(U2);
-  double cosU1 = cos(U1);
-  double cosU2 = cos(U2);
-  double L = ylonr - xlonr;
+  return KernelVincenty::pair(xlon, xlat, ylon, ylat);
+
+}
+
+//' Compute Karney distance between two points
+//'
+//' Geodesic distance on the WGS84 ellipsoid by the method of Karney
+//' (2013). Unlike \code{dist_vincenty()}, it converges for every pair of
+//' points, nearly antipodal ones included, and is accurate to about 15
+//' nanometers.
+//'
+//' @param xlon Longitude for starting coordinate pair
+//' @param xlat Latitude for starting coordinate pair
+//' @param ylon Longitude for ending coordinate pair
+//' @param ylat Latitude for ending coordinate pair
+//' @return Double of distance between coordinate pairs in meters; NaN if
+//'     a latitude is outside [-90, 90]
+//' @export
+// [[Rcpp::export]]
+double dist_karney(const double& xlon,
+		   const double& xlat,
+		   const double& ylon,
+		   const double& ylat) {
+
+  return KernelKarney::pair(xlon, xlat, ylon, ylat);
+
+}
+
+// Vincenty inverse solution given sine and cosine of the reduced
+// latitudes and the difference in longitude (radians)
+double vincenty_inverse(double sinU1,
+			double cosU1,
+			double sinU2,
+			double cosU2,
+			double L) {
+
   double lambda = L;
 
   int iters = 100;
@@ -120,7 +131,8 @@ double dist_vincenty(const double& xlon,
 
   if (iters == 0) {
 
-    throw Rcpp::exception("Failed to converge!");
+    // plain C++ exception: this may run on a worker thread
+    throw std::runtime_error("Failed to converge!");
 
   }
   else {
@@ -164,20 +176,168 @@ Rcpp::NumericVector inverse_value(const Rcpp::NumericVector& d,
 }
 
 // function to choose distance measurement method
-typedef double (*funcPtr)(const double& xlon,
-			  const double& xlat,
-			  const double& ylon,
-			  const double& ylat);
+int dist_kind_of(const std::string& dist_function) {
+
+  if (dist_function == "Vincenty")
+    return DIST_VINCENTY;
+  else if (dist_function == "Karney")
+    return DIST_KARNEY;
+  else if (dist_function == "Andoyer")
+    return DIST_ANDOYER;
+  else if (dist_function == "Thomas")
+    return DIST_THOMAS;
+  else if (dist_function == "Euclidean")
+    return DIST_EUCLIDEAN;
+  else if (dist_function == "Manhattan")
+    return DIST_MANHATTAN;
+  else if (dist_function == "Fast")
+    return DIST_FAST;
+  else if (dist_function != "Haversine")
+    Rcpp::stop("unknown dist_function: " + dist_function);
+
+  return DIST_HAVERSINE;
+
+}
 
-Rcpp::XPtr<funcPtr> choose_func(std::string funcnamestr) {
+// whether distance function measures on the ellipsoid
+bool dist_on_ellipsoid(int kind) {
+  return kind == DIST_VINCENTY || kind == DIST_KARNEY;
+}
 
-  if (funcnamestr == "Haversine")
-    return(Rcpp::XPtr<funcPtr>(new funcPtr(&dist_haversine)));
-  else if (funcnamestr == "Vincenty")
-    return(Rcpp::XPtr<funcPtr>(new funcPtr(&dist_vincenty)));
-  else
-    return Rcpp::XPtr<funcPtr>(R_NilValue);
+// whether distance function measures on the plane
+bool dist_is_planar(int kind) {
+  return kind == DIST_EUCLIDEAN || kind == DIST_MANHATTAN;
+}
+
+// function to choose edge length of square output tiles
+int tile_size(int block_size) {
+
+  if (block_size > 0)
+    return block_size;
+
+  // largest power of two whose tile of doubles fills half the cache
+  int bs = 16;
+  while (2 * bs * 2 * bs * (int)sizeof(double) <= TILE_CACHE_BYTES / 2)
+    bs *= 2;
+
+  return bs;
+
+}
+
+// function to choose value type of returned distances
+int out_kind_of(const std::string& output) {
+
+  if (output == "float")
+    return OUT_FLOAT;
+  else if (output == "meters")
+    return OUT_METERS;
+  else if (output == "decimeters")
+    return OUT_DECIMETERS;
+  else if (output != "double")
+    Rcpp::stop("unknown output: " + output);
+
+  return OUT_DOUBLE;
+
+}
+
+const char* out_kind_name(int output) {
+
+  switch (output) {
+  case OUT_FLOAT: return "float";
+  case OUT_METERS: return "meters";
+  case OUT_DECIMETERS: return "decimeters";
+  default: return "double";
+  }
+
+}
+
+Rcpp::RObject alloc_dist(int output, R_xlen_t len, void** data) {
+
+  if (output == OUT_DOUBLE) {
+    Rcpp::NumericVector out(len);
+    *data = out.begin();
+    return out;
+  }
+
+  Rcpp::IntegerVector out(len);
+  out.attr("dist_output") = out_kind_name(output);
+  *data = out.begin();
+  return out;
+
+}
+
+void store_dist(int output, const double* d, R_xlen_t len, void* data,
+		R_xlen_t at) {
+
+  if (output == OUT_DOUBLE) {
+    std::copy(d, d + len, static_cast<double*>(data) + at);
+    return;
+  }
+
+  int* out = static_cast<int*>(data) + at;
+
+  // NA where not finite, so is.na() holds before conversion too; its
+  // bits are those of -0, which no distance is
+  if (output == OUT_FLOAT) {
+    for (R_xlen_t i = 0; i < len; i++) {
+      if (!std::isfinite(d[i])) {
+	out[i] = NA_INTEGER;
+	continue;
+      }
+      float v = (float) d[i];
+      std::memcpy(out + i, &v, sizeof(v));
+    }
+    return;
+  }
+
+  // round to nearest; NaN fails the range check
+  double scale = output == OUT_DECIMETERS ? 10. : 1.;
+  for (R_xlen_t i = 0; i < len; i++) {
+    double v = std::floor(d[i] * scale + .5);
+    out[i] = v >= 0 && v <= INT_MAX ? (int) v : NA_INTEGER;
+  }
 
 }
 
+//' Convert distances returned in a compact type to doubles
+//'
+//' Distances asked for with \code{output = "float"}, \code{"meters"} or
+//' \code{"decimeters"} come back in integer vectors marked with a
+//' \code{dist_output} attribute. This returns them in meters as doubles,
+//' keeping any matrix dimensions. Subsetting drops the attribute, so
+//' convert before subsetting. Vectors without it are returned as doubles.
+//'
+//' @param x Vector or matrix of distances
+//' @return Vector or matrix of distances in meters
+//' @export
+// [[Rcpp::export]]
+Rcpp::NumericVector dist_as_double(SEXP x) {
+
+  SEXP tag = Rf_getAttrib(x, Rf_install("dist_output"));
+
+  if (Rf_isNull(tag))
+    return Rcpp::NumericVector(x);
+
+  int output = out_kind_of(Rcpp::as<std::string>(tag));
+  Rcpp::IntegerVector v(x);
+  R_xlen_t n = v.size();
+  Rcpp::NumericVector out(n);
+
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (v[i] == NA_INTEGER) {
+      out[i] = NA_REAL;
+    } else if (output == OUT_FLOAT) {
+      float d;
+      std::memcpy(&d, &v[i], sizeof(d));
+      out[i] = d;
+    } else {
+      out[i] = output == OUT_DECIMETERS ? v[i] / 10. : v[i];
+    }
+  }
 
+  Rf_setAttrib(out, R_DimSymbol, Rf_getAttrib(x, R_DimSymbol));
+  Rf_setAttrib(out, R_DimNamesSymbol, Rf_getAttrib(x, R_DimNamesSymbol));
+
+  return out;
+
+}
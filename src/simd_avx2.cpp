@@ -0,0 +1,165 @@
+// simd_avx2.cpp
+#include <simd.h>
+#ifdef DISTRCPP_X86_SIMD
+#include <immintrin.h>
+#endif
+#include <shared.h>
+#include <points.h>
+#include <kernels.h>
+
+#ifdef DISTRCPP_X86_SIMD
+
+#define SIMD_INLINE static inline __attribute__((always_inline, target("avx2")))
+
+// four doubles in an AVX2 register
+struct PackAVX2 {
+
+  typedef __m256d V;
+  typedef __m256d M;
+  enum { W = 4 };
+
+  SIMD_INLINE V load(const double* p) { return _mm256_loadu_pd(p); }
+  SIMD_INLINE void store(double* p, V x) { _mm256_storeu_pd(p, x); }
+  SIMD_INLINE V set1(double x) { return _mm256_set1_pd(x); }
+  SIMD_INLINE V add(V x, V y) { return _mm256_add_pd(x, y); }
+  SIMD_INLINE V sub(V x, V y) { return _mm256_sub_pd(x, y); }
+  SIMD_INLINE V mul(V x, V y) { return _mm256_mul_pd(x, y); }
+  SIMD_INLINE V div(V x, V y) { return _mm256_div_pd(x, y); }
+  SIMD_INLINE V sqrt(V x) { return _mm256_sqrt_pd(x); }
+  SIMD_INLINE M lt(V x, V y) { return _mm256_cmp_pd(x, y, _CMP_LT_OQ); }
+  SIMD_INLINE M gt(V x, V y) { return _mm256_cmp_pd(x, y, _CMP_GT_OQ); }
+  SIMD_INLINE M eq(V x, V y) { return _mm256_cmp_pd(x, y, _CMP_EQ_OQ); }
+  SIMD_INLINE V sel(M m, V x, V y) { return _mm256_blendv_pd(y, x, m); }
+  SIMD_INLINE V neg(V x) { return _mm256_xor_pd(x, _mm256_set1_pd(-0.0)); }
+
+};
+
+#include <simd_math.h>
+
+__attribute__((target("avx2")))
+void haversine_1tom_avx2(double xlon, double xlat,
+			 const double* ylon, const double* ylat,
+			 R_xlen_t n, double* out) {
+  sm_haversine_1tom<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void haversine_pairs_avx2(const double* xlon, const double* xlat,
+			  const double* ylon, const double* ylat,
+			  R_xlen_t n, double* out) {
+  sm_haversine_pairs<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void vincenty_1tom_avx2(double xlon, double xlat,
+			const double* ylon, const double* ylat,
+			R_xlen_t n, double* out) {
+  sm_vincenty_1tom<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void vincenty_pairs_avx2(const double* xlon, const double* xlat,
+			 const double* ylon, const double* ylat,
+			 R_xlen_t n, double* out) {
+  sm_vincenty_pairs<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void haversine_prep_1tom_avx2(const PointSet& x, R_xlen_t i,
+			      const PointSet& y, R_xlen_t lo,
+			      R_xlen_t hi, double* out) {
+  sm_haversine_prep_1tom<PackAVX2>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void haversine_prep_pairs_avx2(const PointSet& x, const PointSet& y,
+			       R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_haversine_prep_pairs<PackAVX2>(x, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void vincenty_prep_1tom_avx2(const PointSet& x, R_xlen_t i,
+			     const PointSet& y, R_xlen_t lo,
+			     R_xlen_t hi, double* out) {
+  sm_vincenty_prep_1tom<PackAVX2>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void vincenty_prep_pairs_avx2(const PointSet& x, const PointSet& y,
+			      R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_vincenty_prep_pairs<PackAVX2>(x, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void flattening_1tom_avx2(bool thomas, double xlon, double xlat,
+			  const double* ylon, const double* ylat,
+			  R_xlen_t n, double* out) {
+  sm_flattening_1tom<PackAVX2>(thomas, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void flattening_pairs_avx2(bool thomas,
+			   const double* xlon, const double* xlat,
+			   const double* ylon, const double* ylat,
+			   R_xlen_t n, double* out) {
+  sm_flattening_pairs<PackAVX2>(thomas, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void flattening_prep_1tom_avx2(bool thomas,
+			       const PointSet& x, R_xlen_t i,
+			       const PointSet& y, R_xlen_t lo,
+			       R_xlen_t hi, double* out) {
+  sm_flattening_prep_1tom<PackAVX2>(thomas, x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void flattening_prep_pairs_avx2(bool thomas,
+				const PointSet& x, const PointSet& y,
+				R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_flattening_prep_pairs<PackAVX2>(thomas, x, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void planar_1tom_avx2(bool manhattan, double xlon, double xlat,
+		      const double* ylon, const double* ylat,
+		      R_xlen_t n, double* out) {
+  sm_planar_1tom<PackAVX2>(manhattan, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void planar_pairs_avx2(bool manhattan,
+		       const double* xlon, const double* xlat,
+		       const double* ylon, const double* ylat,
+		       R_xlen_t n, double* out) {
+  sm_planar_pairs<PackAVX2>(manhattan, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void fast_1tom_avx2(double xlon, double xlat,
+		    const double* ylon, const double* ylat,
+		    R_xlen_t n, double* out) {
+  sm_fast_1tom<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void fast_pairs_avx2(const double* xlon, const double* xlat,
+		     const double* ylon, const double* ylat,
+		     R_xlen_t n, double* out) {
+  sm_fast_pairs<PackAVX2>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx2")))
+void fast_prep_1tom_avx2(const PointSet& x, R_xlen_t i,
+			 const PointSet& y, R_xlen_t lo,
+			 R_xlen_t hi, double* out) {
+  sm_fast_prep_1tom<PackAVX2>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx2")))
+void fast_prep_pairs_avx2(const PointSet& x, const PointSet& y,
+			  R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_fast_prep_pairs<PackAVX2>(x, y, lo, hi, out);
+}
+
+#endif
@@ -0,0 +1,165 @@
+// simd_avx512.cpp
+#include <simd.h>
+#ifdef DISTRCPP_X86_SIMD
+#include <immintrin.h>
+#endif
+#include <shared.h>
+#include <points.h>
+#include <kernels.h>
+
+#ifdef DISTRCPP_X86_SIMD
+
+#define SIMD_INLINE static inline __attribute__((always_inline, target("avx512f")))
+
+// eight doubles in an AVX-512 register
+struct PackAVX512 {
+
+  typedef __m512d V;
+  typedef __mmask8 M;
+  enum { W = 8 };
+
+  SIMD_INLINE V load(const double* p) { return _mm512_loadu_pd(p); }
+  SIMD_INLINE void store(double* p, V x) { _mm512_storeu_pd(p, x); }
+  SIMD_INLINE V set1(double x) { return _mm512_set1_pd(x); }
+  SIMD_INLINE V add(V x, V y) { return _mm512_add_pd(x, y); }
+  SIMD_INLINE V sub(V x, V y) { return _mm512_sub_pd(x, y); }
+  SIMD_INLINE V mul(V x, V y) { return _mm512_mul_pd(x, y); }
+  SIMD_INLINE V div(V x, V y) { return _mm512_div_pd(x, y); }
+  SIMD_INLINE V sqrt(V x) { return _mm512_sqrt_pd(x); }
+  SIMD_INLINE M lt(V x, V y) { return _mm512_cmp_pd_mask(x, y, _CMP_LT_OQ); }
+  SIMD_INLINE M gt(V x, V y) { return _mm512_cmp_pd_mask(x, y, _CMP_GT_OQ); }
+  SIMD_INLINE M eq(V x, V y) { return _mm512_cmp_pd_mask(x, y, _CMP_EQ_OQ); }
+  SIMD_INLINE V sel(M m, V x, V y) { return _mm512_mask_blend_pd(m, y, x); }
+  SIMD_INLINE V neg(V x) { return _mm512_sub_pd(_mm512_setzero_pd(), x); }
+
+};
+
+#include <simd_math.h>
+
+__attribute__((target("avx512f")))
+void haversine_1tom_avx512(double xlon, double xlat,
+			   const double* ylon, const double* ylat,
+			   R_xlen_t n, double* out) {
+  sm_haversine_1tom<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void haversine_pairs_avx512(const double* xlon, const double* xlat,
+			    const double* ylon, const double* ylat,
+			    R_xlen_t n, double* out) {
+  sm_haversine_pairs<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void vincenty_1tom_avx512(double xlon, double xlat,
+			  const double* ylon, const double* ylat,
+			  R_xlen_t n, double* out) {
+  sm_vincenty_1tom<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void vincenty_pairs_avx512(const double* xlon, const double* xlat,
+			   const double* ylon, const double* ylat,
+			   R_xlen_t n, double* out) {
+  sm_vincenty_pairs<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void haversine_prep_1tom_avx512(const PointSet& x, R_xlen_t i,
+				const PointSet& y, R_xlen_t lo,
+				R_xlen_t hi, double* out) {
+  sm_haversine_prep_1tom<PackAVX512>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void haversine_prep_pairs_avx512(const PointSet& x, const PointSet& y,
+				 R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_haversine_prep_pairs<PackAVX512>(x, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void vincenty_prep_1tom_avx512(const PointSet& x, R_xlen_t i,
+			       const PointSet& y, R_xlen_t lo,
+			       R_xlen_t hi, double* out) {
+  sm_vincenty_prep_1tom<PackAVX512>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void vincenty_prep_pairs_avx512(const PointSet& x, const PointSet& y,
+				R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_vincenty_prep_pairs<PackAVX512>(x, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void flattening_1tom_avx512(bool thomas, double xlon, double xlat,
+			    const double* ylon, const double* ylat,
+			    R_xlen_t n, double* out) {
+  sm_flattening_1tom<PackAVX512>(thomas, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void flattening_pairs_avx512(bool thomas,
+			     const double* xlon, const double* xlat,
+			     const double* ylon, const double* ylat,
+			     R_xlen_t n, double* out) {
+  sm_flattening_pairs<PackAVX512>(thomas, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void flattening_prep_1tom_avx512(bool thomas,
+				 const PointSet& x, R_xlen_t i,
+				 const PointSet& y, R_xlen_t lo,
+				 R_xlen_t hi, double* out) {
+  sm_flattening_prep_1tom<PackAVX512>(thomas, x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void flattening_prep_pairs_avx512(bool thomas,
+				  const PointSet& x, const PointSet& y,
+				  R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_flattening_prep_pairs<PackAVX512>(thomas, x, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void planar_1tom_avx512(bool manhattan, double xlon, double xlat,
+			const double* ylon, const double* ylat,
+			R_xlen_t n, double* out) {
+  sm_planar_1tom<PackAVX512>(manhattan, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void planar_pairs_avx512(bool manhattan,
+			 const double* xlon, const double* xlat,
+			 const double* ylon, const double* ylat,
+			 R_xlen_t n, double* out) {
+  sm_planar_pairs<PackAVX512>(manhattan, xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void fast_1tom_avx512(double xlon, double xlat,
+		      const double* ylon, const double* ylat,
+		      R_xlen_t n, double* out) {
+  sm_fast_1tom<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void fast_pairs_avx512(const double* xlon, const double* xlat,
+		       const double* ylon, const double* ylat,
+		       R_xlen_t n, double* out) {
+  sm_fast_pairs<PackAVX512>(xlon, xlat, ylon, ylat, n, out);
+}
+
+__attribute__((target("avx512f")))
+void fast_prep_1tom_avx512(const PointSet& x, R_xlen_t i,
+			   const PointSet& y, R_xlen_t lo,
+			   R_xlen_t hi, double* out) {
+  sm_fast_prep_1tom<PackAVX512>(x, i, y, lo, hi, out);
+}
+
+__attribute__((target("avx512f")))
+void fast_prep_pairs_avx512(const PointSet& x, const PointSet& y,
+			    R_xlen_t lo, R_xlen_t hi, double* out) {
+  sm_fast_prep_pairs<PackAVX512>(x, y, lo, hi, out);
+}
+
+#endif